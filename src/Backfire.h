@@ -32,6 +32,8 @@ public:
   using IsCutBusyFn     = bool     (*)();          // đang có cut nào đang chạy?
   using RequestIgnCutFn = void     (*)(uint16_t);  // yêu cầu cắt IGN ms
   using IsIgnModeFn     = bool     (*)();          // output hiện tại là IGN?
+  using GetDrpmFn       = int32_t  (*)();          // dRPM/dt đã lọc (rpm/s), tuỳ chọn
+  using RequestBurstFn  = void     (*)(uint8_t count, uint16_t on_ms, uint16_t off_ms); // xếp cả chuỗi, tuỳ chọn
 
   void begin(const Config& cfg,
              GetRpmFn getRpm,
@@ -67,6 +69,12 @@ public:
     }
   }
 
+  // nguồn dRPM/dt ngoài (vd. bộ lọc alpha-beta theo cạnh); nullptr = tự vi phân 20ms
+  void setDrpmSource(GetDrpmFn fn) { _getDrpm = fn; }
+
+  // xếp nguyên chuỗi nhịp vào hàng đợi cắt (định thời µs); nullptr = bắn từng nhịp theo tick()
+  void setBurstSink(RequestBurstFn fn) { _requestBurst = fn; }
+
   // gọi một lần sau begin để đánh dấu thời điểm bắt đầu chạy
   void markStarted(uint32_t now_ms) { _startedAt = now_ms; }
 
@@ -85,7 +93,9 @@ public:
     // cập nhật dRPM/dt (đủ 20ms mới cập nhật để bớt nhiễu)
     const uint16_t rpm = _getRpm();
     const uint32_t dt  = now_ms - _lastTs;
-    if (dt >= 20) {
+    if (_getDrpm) {
+      _drpm_per_s = _getDrpm();
+    } else if (dt >= 20) {
       const int32_t drpm = (int32_t)rpm - (int32_t)_lastRpm;
       _drpm_per_s = (int32_t)((int64_t)drpm * 1000 / (int32_t)dt);
       _lastRpm = rpm;
@@ -130,6 +140,11 @@ private:
     _patternEnd  = now_ms + (uint32_t)(on_ms + off_ms) * (uint32_t)_burstsLeft;
     _lastFireAt  = now_ms;
     _shiftWindowUntil = 0;  // dùng 1 lần sau SHIFT
+
+    if (_requestBurst) {
+      _requestBurst(_burstsLeft, on_ms, off_ms);
+      _burstsLeft = 0;      // cả chuỗi đã nằm trong hàng đợi; chỉ chờ _patternEnd
+    }
   }
 
   // ===== data =====
@@ -139,6 +154,8 @@ private:
   IsCutBusyFn     _isBusy        = nullptr;
   RequestIgnCutFn _requestIgnCut = nullptr;
   IsIgnModeFn     _isIgnMode     = nullptr;
+  GetDrpmFn       _getDrpm       = nullptr;
+  RequestBurstFn  _requestBurst  = nullptr;
 
   uint16_t _lastRpm = 0;
   uint32_t _lastTs  = 0;
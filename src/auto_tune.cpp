@@ -0,0 +1,120 @@
+#include "auto_tune.h"
+#include "config_store.h"
+#include "rpm_rmt.h"
+
+static constexpr uint8_t  PRE_EDGES = 4;        // số cạnh lấy trước lúc cắt (RPM trước sang số)
+static constexpr uint16_t MAX_EDGES = 128;      // ~190 ms ở 20000 rpm, ppr 2
+static constexpr uint32_t WINDOW_US = 300000;   // ghi vết 300 ms sau khi mở cắt
+static constexpr uint32_t GRACE_US  = 50000;    // chờ thêm cho RMT giao lô cuối
+static constexpr int16_t  STEP_UP   = 4;        // mỗi lần sang số tăng tối đa 4 ms
+static constexpr int16_t  STEP_DN   = 2;        // giảm chậm hơn: cắt thiếu nguy hiểm hơn cắt thừa
+
+static uint32_t s_ts[MAX_EDGES];
+static uint16_t s_n = 0;
+static uint32_t s_cursor = 0, s_t0 = 0;
+static bool     s_busy = false;
+static uint8_t  s_band = 0;
+static uint16_t s_rpm0 = 0, s_cut = 0;
+
+static ATUNE::Result s_last{};
+static uint16_t s_settle[7], s_count[7];
+
+static inline uint16_t med3(uint16_t a, uint16_t b, uint16_t c){
+  return max(min(a,b), min(max(a,b), c));
+}
+
+static uint8_t findBand(uint16_t rpm, const QSConfig &c){
+  const uint8_t n = constrain(c.map_count, (uint8_t)1, (uint8_t)7);
+  for (uint8_t i=0;i<n;i++) if (rpm >= c.map[i].rpm_lo && rpm < c.map[i].rpm_hi) return i;
+  return 0xFF;
+}
+
+// Phân tích vết: trả thời gian ổn định (µs) hoặc verdict lỗi
+static uint8_t analyze(uint32_t &settle_us){
+  int32_t  tp[MAX_EDGES]; uint16_t rp[MAX_EDGES]; bool ag[MAX_EDGES];
+  uint16_t pre[PRE_EDGES]; uint8_t np = 0;
+  uint16_t n = 0; uint32_t pPrev = 0; bool gap = false;
+
+  for (uint16_t k=1;k<s_n;k++){
+    const uint32_t p = s_ts[k] - s_ts[k-1];
+    if (!p) continue;
+    const int32_t tm = (int32_t)(s_ts[k-1] + p/2 - s_t0);     // giữa chu kỳ, so với lúc cắt
+    // chu kỳ dài đột ngột = mất cạnh (cắt IGN tắt luôn xung bobin): không lấy làm điểm đo
+    if (pPrev && p > pPrev + (pPrev >> 1) + (pPrev >> 3)) { gap = true; continue; }
+    pPrev = p;
+    const uint16_t r = RPM::periodToRpm(p);
+    if (tm <= 0) { if (np < PRE_EDGES) pre[np++] = r; else { memmove(pre, pre+1, sizeof(pre)-sizeof(pre[0])); pre[PRE_EDGES-1] = r; } continue; }
+    tp[n] = tm; rp[n] = r; ag[n] = gap; gap = false; n++;
+  }
+  if (n < 4) return ATUNE::SHORT;
+
+  uint16_t r0 = s_rpm0;
+  if (np >= 3) r0 = med3(pre[np-3], pre[np-2], pre[np-1]);
+  else if (np) r0 = pre[np-1];
+
+  // làm mượt trung vị 3 điểm, tìm đáy
+  uint16_t sm[MAX_EDGES]; uint16_t post = 0xFFFF;
+  for (uint16_t i=0;i<n;i++){
+    sm[i] = (i == 0 || i+1 == n) ? rp[i] : med3(rp[i-1], rp[i], rp[i+1]);
+    if (sm[i] < post) post = sm[i];
+  }
+  if (post >= r0 || (uint32_t)(r0 - post) * 32 < r0) return ATUNE::MISS;   // rơi < 3%
+
+  // ổn định: lần đầu còn cách đáy < 1/8 quãng rơi
+  const uint16_t thr = post + (r0 - post) / 8;
+  for (uint16_t i=0;i<n;i++){
+    if (sm[i] > thr) continue;
+    if (ag[i]) return ATUNE::BLIND;    // chỉ biết đã ổn định đâu đó trong khoảng mất cạnh
+    settle_us = (uint32_t)tp[i];
+    return ATUNE::TUNED;
+  }
+  return ATUNE::MISS;
+}
+
+static void finish(){
+  s_busy = false;
+  ATUNE::Result res{};
+  res.band = s_band; res.cut_ms = s_cut;
+  uint32_t settle_us = 0;
+  res.verdict = analyze(settle_us);
+  const QSConfig &c = CFG::get();
+  res.new_ms = c.map[s_band].cut_ms;
+  if (res.verdict == ATUNE::TUNED) {
+    res.settle_ms = (uint16_t)((settle_us + 999) / 1000);
+    const int16_t err = (int16_t)(res.settle_ms + c.at_margin_ms) - (int16_t)s_cut;
+    const int16_t step = err > 0 ? min<int16_t>(err, STEP_UP) : max<int16_t>(err / 2, -STEP_DN);
+    res.new_ms = (uint16_t)constrain((int16_t)res.new_ms + step, (int16_t)CUT_MS_MIN, (int16_t)CUT_MS_MAX);
+    CFG::setBandCut(s_band, res.new_ms);   // áp bởi task cfgsave, vài ms sau
+    s_settle[s_band] = res.settle_ms;
+    s_count[s_band]++;
+  }
+  s_last = res;
+}
+
+void ATUNE::onCut(uint16_t rpm, uint16_t cut_ms){
+  if (s_busy) return;
+  const uint8_t b = findBand(rpm, CFG::get());
+  if (b == 0xFF) return;
+  const uint32_t h = RPM::edgeHead();
+  s_cursor = h > PRE_EDGES ? h - (PRE_EDGES + 1) : 0;
+  s_n = 0; s_t0 = micros();
+  s_band = b; s_rpm0 = rpm; s_cut = cut_ms;
+  s_busy = true;
+}
+
+void ATUNE::update(){
+  if (!s_busy) return;
+  while (s_n < MAX_EDGES) {
+    const size_t got = RPM::readEdges(s_cursor, s_ts + s_n, MAX_EDGES - s_n);
+    if (!got) break;
+    s_n += got;
+  }
+  const bool full = s_n >= MAX_EDGES;
+  const bool past = s_n && (int32_t)(s_ts[s_n-1] - s_t0) > (int32_t)WINDOW_US;
+  if (full || past || (micros() - s_t0) > WINDOW_US + GRACE_US) finish();
+}
+
+bool ATUNE::busy(){ return s_busy; }
+ATUNE::Result ATUNE::last(){ return s_last; }
+uint16_t ATUNE::bandSettle(uint8_t band){ return band < 7 ? s_settle[band] : 0; }
+uint16_t ATUNE::bandCount(uint8_t band){ return band < 7 ? s_count[band] : 0; }
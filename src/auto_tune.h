@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+
+// Tự chỉnh cut_ms của dải AUTO theo đáp ứng RPM đo được quanh mỗi lần sang số.
+// Ghi vết cạnh RPM thô (RPM::readEdges) từ lúc mở cắt, tìm thời điểm RPM rơi
+// ổn định về tỉ số mới, rồi đẩy cut_ms của dải về (ổn định + biên), kẹp CUT_MS_MIN/MAX.
+namespace ATUNE {
+  enum Verdict : uint8_t {
+    NONE  = 0,
+    TUNED = 1,   // đã đo và chỉnh (có thể giữ nguyên nếu đã đúng)
+    MISS  = 2,   // RPM không rơi đủ -> không có sang số, bỏ qua
+    BLIND = 3,   // mất cạnh suốt lúc cắt (IGN cắt luôn tín hiệu bobin) -> không đo được
+    SHORT = 4    // quá ít cạnh để phân tích
+  };
+  struct Result {
+    uint8_t  band;        // dải được chỉnh
+    uint16_t cut_ms;      // thời gian cắt đã dùng
+    uint16_t settle_ms;   // thời gian từ lúc cắt tới khi RPM ổn định
+    uint16_t new_ms;      // cut_ms mới của dải
+    uint8_t  verdict;
+  };
+
+  void onCut(uint16_t rpm, uint16_t cut_ms);   // gọi khi vừa mở cắt (chỉ khi được phép chỉnh)
+  void update();                               // gọi mỗi tick
+  bool busy();                                 // đang ghi vết
+  Result last();
+  uint16_t bandSettle(uint8_t band);           // thời gian ổn định gần nhất của dải
+  uint16_t bandCount(uint8_t band);            // số lần đã chỉnh dải
+}
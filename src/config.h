@@ -4,27 +4,64 @@
 // ===== Defaults & Limits =====
 // Modes
 enum class Mode : uint8_t { MANUAL = 0, AUTO = 1 };
-enum class RpmSource : uint8_t { COIL = 0, INJECTOR = 1 };
+enum class RpmSource : uint8_t { COIL = 0, INJECTOR = 1 };   // INJECTOR: đo thêm độ rộng/duty kim phun (áp dụng khi khởi động)
+enum class RpmBackend : uint8_t { GPIO = 0, RMT = 1 }; // cách bắt cạnh RPM (áp dụng khi khởi động)
 enum class CutOutputSel : uint8_t { IGN = 0, INJ = 1 };
+enum class CutMode : uint8_t { MS = 0, SPARK = 1, PROG = 2 };   // cắt theo ms, số tia lửa, hoặc lũy tiến theo tỉ lệ
+
+// Cắt lũy tiến: tỉ lệ tia lửa bị bỏ (%) dọc cửa sổ cut_sparks, nội suy giữa các điểm
+static constexpr uint8_t PROG_PTS = 8;
 
 struct AutoBand { uint16_t rpm_lo; uint16_t rpm_hi; uint16_t cut_ms; };
+
+// Bản đồ cắt 2 chiều: RPM (trục X) × trục Y, nội suy song tuyến
+static constexpr uint8_t MAP2D_X = 8;
+static constexpr uint8_t MAP2D_Y = 6;
+enum class MapYSrc : uint8_t { GEAR = 0, LOAD = 1 };   // trục Y: số đang chạy trước khi sang, hoặc tải = duty kim phun (‰)
+struct CutMap2D {
+  uint8_t  enabled = 0;                      // 0 = dùng map 1 chiều
+  MapYSrc  y_src   = MapYSrc::GEAR;
+  uint8_t  nx = 8, ny = 5;
+  uint16_t x_rpm[MAP2D_X] = {3000, 4500, 6000, 7500, 9000, 10500, 12000, 13500};
+  uint16_t y_val[MAP2D_Y] = {1, 2, 3, 4, 5, 6};
+  uint16_t cut_ms[MAP2D_Y][MAP2D_X] = {
+    {90, 82, 74, 66, 60, 55, 50, 46},        // 1 -> 2
+    {80, 72, 65, 58, 53, 48, 44, 40},        // 2 -> 3
+    {75, 67, 60, 54, 49, 45, 41, 38},        // 3 -> 4
+    {70, 63, 57, 51, 46, 42, 39, 36},        // 4 -> 5
+    {66, 60, 54, 48, 44, 40, 37, 34},        // 5 -> 6
+    {66, 60, 54, 48, 44, 40, 37, 34}
+  };
+};
 struct BackfireCfg {
   bool     enabled        = false;   // đã có
   uint16_t rpm_min        = 5000;    // đã có
   uint16_t extra_ms       = 15;      // đã có
   bool     force_ign      = true;    // MỚI: ép cắt IGN khi backfire
-  uint8_t  skip_sparks    = 0;       // MỚI: số tia lửa bỏ qua sau cắt (0..2)
+  uint8_t  skip_sparks    = 0;       // số tia lửa bị cắt mỗi nhịp burst (0 = theo burst_on ms)
 };
 
 struct QSConfig {
   Mode mode = Mode::AUTO;
   RpmSource rpm_source = RpmSource::COIL;
+  RpmBackend rpm_backend = RpmBackend::GPIO;
   float ppr = 1.0f;                 // 0.5 / 1 / 2 selectable
+  uint8_t rpm_avg_n = 4;            // số chu kỳ lọc RPM (1..16)
+  uint8_t rpm_filter = 0;           // 0 = trung bình loại outlier, 1 = trung vị
+  uint8_t trk_alpha = 77;           // alpha-beta tracker: alpha * 256
+  uint8_t trk_beta  = 13;           // alpha-beta tracker: beta * 256
   uint16_t rpm_min = 2500;          // Below this no cut
   uint16_t manual_kill_ms = 70;     // Manual cut time
   uint16_t debounce_shift_ms = 15;  // Shift sensor debounce
   uint16_t holdoff_ms = 200;        // Lockout after cut
+  uint8_t  trig_fast = 0;           // 1 = ISR của cảm biến sang số bắn cắt trực tiếp
+  uint8_t  at_enable = 0;           // 1 = tự chỉnh cut_ms từng dải AUTO theo đáp ứng RPM
+  uint8_t  at_margin_ms = 6;        // cut = thời gian RPM ổn định + biên này
   CutOutputSel cut_output = CutOutputSel::IGN; // default output
+  CutMode  cut_mode   = CutMode::MS;  // SPARK: bỏ cut_sparks tia liền sau cạnh N; PROG: bỏ theo prog_pct
+  uint8_t  cut_sparks = 6;            // độ dài cắt QS tính bằng chu kỳ đánh lửa (1..64)
+  uint8_t  prog_n = 3;                // PROG: số điểm trong prog_pct (1..PROG_PTS)
+  uint8_t  prog_pct[PROG_PTS] = {50, 100, 50};   // PROG: % tia lửa bị bỏ, trải đều từ đầu tới cuối cửa sổ
   // Backfire (relay-simple): OFF by default per user request
     BackfireCfg backfire;
   bool backfire_enabled = false;
@@ -62,6 +99,7 @@ struct QSConfig {
 
   
   uint8_t map_count = 4;
+  CutMap2D map2d;
   // Wi-Fi AP config
   char     ap_ssid[33]  = "";        // empty -> auto SSID
   char     ap_pass[65]  = "12345678"; // min 8 chars for AP
@@ -74,6 +112,13 @@ struct QSConfig {
   uint16_t lock_gap_ms       = 400;  // khoảng nghỉ tối đa giữa hai nhịp
   uint16_t lock_timeout_s    = 30;   // thời gian cho phép nhập, hết giờ -> giữ khóa
   uint8_t  lock_max_retries  = 5;    // số lần sai tối đa, vượt -> giữ khóa (có thể cần tắt mở lại)
+  // Cử chỉ cần số chọn profile (khi không khóa, máy dưới rpm_min): 1 nhịp dài + N nhịp ngắn -> profile N
+  uint8_t  prof_gesture      = 1;
+  // Telemetry đẩy qua SSE (/api/events): số khung RPM mỗi giây (1..50)
+  uint8_t  tele_hz           = 20;
+  // Nguồn RPM kim phun: 1 = mức thấp là kim mở (chân lấy ở cực âm kim, driver low-side,
+  // qua chia áp/kẹp áp tới GPIO kéo lên); 0 = mức cao là mở (tầng vào đảo, vd. opto/NPN). Áp khi khởi động.
+  uint8_t  inj_active_low    = 1;
 
 };
 
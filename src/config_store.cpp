@@ -1,33 +1,283 @@
 #include "config_store.h"
 #include <Preferences.h>
 #include <ArduinoJson.h>
+#include "cut_map.h"
+#include <atomic>
+#include <esp_rom_crc.h>
 
 static Preferences prefs;
-static QSConfig g_cfg;
 
-void CFG::begin(){
-  prefs.begin("qs", false);
+// ===== Profile + phiên bản RCU =====
+// Mỗi profile hai ô phiên bản đã biên dịch; s_pub trỏ ô hiện hành của profile đang chọn.
+// Bên ghi (giữ s_wlock) chỉ sửa ô dự phòng rồi lật; đổi profile chỉ đổi con trỏ (O(1)).
+static constexpr uint8_t P = CFG::PROFILES;
+static CtrlParams s_pool[P][2];
+static uint8_t    s_curSlot[P];                 // ô hiện hành của từng profile
+static uint8_t    s_active = 0;
+static uint32_t   s_gen = 0;                    // gen duy nhất cho mọi ô: đổi profile cũng thấy gen mới
+static std::atomic<const CtrlParams*> s_pub{&s_pool[0][0]};
+static std::atomic<uint32_t> s_pubGen{0};
+static SemaphoreHandle_t s_wlock = nullptr;
+static std::atomic<uint32_t> s_qs{0};          // số lần task điều khiển qua điểm tĩnh
+static uint32_t s_pubQs = 0;                   // s_qs lúc công bố gần nhất
+static volatile bool s_reader = false;         // đã có task điều khiển đọc
+static constexpr uint32_t GRACE_MAX_MS = 50;
+
+// Cấu hình của thiết bị, không theo profile: luôn giống nhau ở mọi profile
+static void copyGlobals(QSConfig &d, const QSConfig &s){
+  d.rpm_source = s.rpm_source; d.rpm_backend = s.rpm_backend;
+  d.ppr = s.ppr; d.rpm_scale = s.rpm_scale;
+  d.ap_timeout_s = s.ap_timeout_s;
+  memcpy(d.ap_ssid, s.ap_ssid, sizeof(d.ap_ssid)); memcpy(d.ap_pass, s.ap_pass, sizeof(d.ap_pass));
+  d.lock_enabled = s.lock_enabled; d.lock_cut_sel = s.lock_cut_sel;
+  memcpy(d.lock_code, s.lock_code, sizeof(d.lock_code));
+  d.lock_short_ms_max = s.lock_short_ms_max; d.lock_long_ms_min = s.lock_long_ms_min;
+  d.lock_gap_ms = s.lock_gap_ms; d.lock_timeout_s = s.lock_timeout_s; d.lock_max_retries = s.lock_max_retries;
+  d.prof_gesture = s.prof_gesture;
+  d.tele_hz = s.tele_hz;
+  d.inj_active_low = s.inj_active_low;
+}
+
+static uint32_t rpmK(float ppr, float scale){
+  ppr = max(0.1f, ppr); if (scale <= 0) scale = 1.0f;
+  const float k = 60.0f * 1e6f * scale / ppr;
+  return (k >= 4294967295.0f) ? 0xFFFFFFFFUL : (uint32_t)k;
+}
+
+// Bản cũ (ô dự phòng) hết người đọc khi task điều khiển đã qua điểm tĩnh sau lần công bố
+static bool graceOk(){ return !s_reader || s_qs.load(std::memory_order_acquire) != s_pubQs; }
+
+static inline CtrlParams& spare(uint8_t j){ return s_pool[j][s_curSlot[j] ^ 1]; }
+static inline const CtrlParams& current(uint8_t j){ return s_pool[j][s_curSlot[j]]; }
+
+// Biên dịch ô dự phòng của profile j (cfg đã điền) rồi lật thành ô hiện hành. Giữ s_wlock.
+static void flip(uint8_t j){
+  CtrlParams &nx = spare(j);
+  nx.gen = ++s_gen;
+  nx.rpm_k = rpmK(nx.cfg.ppr, nx.cfg.rpm_scale);
+  CMAP::compile(nx.cfg, nx.map);
+  s_curSlot[j] ^= 1;
+}
+
+static void publishActive(){
+  s_pubQs = s_qs.load(std::memory_order_relaxed);
+  s_pub.store(&current(s_active), std::memory_order_release);
+  s_pubGen.store(current(s_active).gen, std::memory_order_release);
+}
+
+// Chiếm quyền ghi; wait = false thì bỏ ngay nếu có bên ghi khác hoặc bản cũ còn người đọc
+static bool writeBegin(bool wait){
+  if (xSemaphoreTake(s_wlock, wait ? portMAX_DELAY : 0) != pdTRUE) return false;
+  const uint32_t t0 = millis();
+  while (!graceOk()) {
+    if (!wait) { xSemaphoreGive(s_wlock); return false; }
+    if (millis() - t0 > GRACE_MAX_MS) break;   // task điều khiển dừng hẳn: không còn ai đọc dở
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+// ===== Blob cấu hình trong NVS =====
+// Mỗi profile một nhật ký hai ô, mỗi ô = header (có seq) + ảnh QSConfig. Lưu luôn ghi đè ô cũ hơn,
+// nên mất điện giữa chừng chỉ hỏng ô đang ghi; nạp chọn ô hợp lệ có seq lớn nhất.
+// Trường mới của QSConfig chỉ thêm vào cuối: blob ngắn hơn (firmware cũ) vẫn nạp được,
+// phần thiếu giữ mặc định. Đổi bố cục không tương thích thì tăng BLOB_VER.
+static constexpr uint32_t BLOB_MAGIC = 0x47464351;   // "QCFG"
+static constexpr uint16_t BLOB_VER   = 2;            // v1: một khóa "cfg", header không có seq
+static constexpr size_t   HDR_V1     = 12;
+struct BlobHdr { uint32_t magic; uint16_t ver; uint16_t len; uint32_t crc; uint32_t seq; };
+struct Blob { BlobHdr h; QSConfig cfg; };
+struct Journal {
+  Blob     blob;                    // ảnh đã lưu gần nhất (so để biết có đổi không); chỉ task lưu chạm vào
+  bool     ok;
+  uint32_t seq;                     // seq của ô mới nhất
+  uint8_t  cur;                     // ô mới nhất (lần lưu sau ghi ô kia)
+};
+static Journal s_jr[P];
+
+// Tên, profile đang chọn: một khóa nhỏ, ghi trễ như cấu hình
+struct ProfMeta { uint8_t active; char name[P][CFG::PROFILE_NAME_LEN]; };
+static ProfMeta s_meta = {0, {"street", "track", "rain"}};
+
+static void slotKey(char *k, uint8_t prof, uint8_t slot){
+  if (prof) snprintf(k, 12, "p%ucfg%u", prof, slot);
+  else      snprintf(k, 12, "cfg%u", slot);    // profile 0 giữ khóa của bản một cấu hình
+}
+
+// Chuẩn hóa sau khi nạp (blob hoặc khóa cũ)
+static void sanitize(QSConfig &c){
+  if (c.map_count == 0) c.map_count = 1;   // at least one band
+  if (c.map_count > 7)  c.map_count = 7;
+  c.prog_n = constrain(c.prog_n, (uint8_t)1, PROG_PTS);
+  c.ap_ssid[sizeof(c.ap_ssid)-1] = 0;
+  c.ap_pass[sizeof(c.ap_pass)-1] = 0;
+  c.lock_code[sizeof(c.lock_code)-1] = 0;
+}
+
+// Đọc một khóa vào b, kiểm header + CRC; v1 được dời payload về chỗ của v2 (seq = 0)
+static bool readBlob(const char *key, Blob &b){
+  const size_t n = prefs.getBytes(key, &b, sizeof(b));
+  BlobHdr &h = b.h;
+  if (n < HDR_V1 || h.magic != BLOB_MAGIC) return false;
+  size_t hs = sizeof(BlobHdr);
+  if (h.ver == 1) { hs = HDR_V1; memmove(&b.cfg, (uint8_t*)&b + HDR_V1, n - HDR_V1); h.seq = 0; }
+  else if (h.ver != BLOB_VER) return false;
+  if (n != hs + h.len || h.len > sizeof(QSConfig)) return false;
+  return esp_rom_crc32_le(0, (const uint8_t*)&b.cfg, h.len) == h.crc;
+}
+
+static bool loadBlob(uint8_t prof, QSConfig &c){
+  Journal &J = s_jr[prof];
+  char key[12];
+  int8_t best = -1; uint32_t bestSeq = 0;
+  for (uint8_t i=0;i<2;i++) {
+    slotKey(key, prof, i);
+    if (readBlob(key, J.blob) && (best < 0 || (int32_t)(J.blob.h.seq - bestSeq) > 0)) { best = i; bestSeq = J.blob.h.seq; }
+  }
+  if (best >= 0) { slotKey(key, prof, best); readBlob(key, J.blob); J.cur = best; }
+  else if (prof == 0 && readBlob("cfg", J.blob)) J.cur = 1;   // blob v1 (firmware trước): lần lưu đầu ghi vào cfg0
+  else { J.cur = 1; return false; }
+  J.seq = J.blob.h.seq;
+  const uint16_t len = J.blob.h.len;
+  memcpy(&c, &J.blob.cfg, len);           // blob cũ ngắn hơn: phần đuôi giữ mặc định
+  sanitize(c);
+  J.blob.cfg = c;
+  J.ok = (len == sizeof(QSConfig) && best >= 0);   // khác kích thước / còn ở v1: lần lưu sau ghi lại đủ
+  return true;
+}
+
+// Ghi ảnh vào ô cũ hơn nếu khác bản đã lưu
+static bool saveBlob(uint8_t prof, const QSConfig &c){
+  Journal &J = s_jr[prof];
+  if (J.ok && memcmp(&J.blob.cfg, &c, sizeof(QSConfig)) == 0) return true;
+  memcpy(&J.blob.cfg, &c, sizeof(QSConfig));
+  J.blob.h = BlobHdr{BLOB_MAGIC, BLOB_VER, (uint16_t)sizeof(QSConfig),
+                     esp_rom_crc32_le(0, (const uint8_t*)&J.blob.cfg, sizeof(QSConfig)), J.seq + 1};
+  const uint8_t slot = J.cur ^ 1;
+  char key[12]; slotKey(key, prof, slot);
+  J.ok = prefs.putBytes(key, &J.blob, sizeof(J.blob)) == sizeof(J.blob);
+  if (J.ok) { J.cur = slot; J.seq++; if (prof == 0 && J.seq == 1) prefs.remove("cfg"); }
+  return J.ok;
+}
+
+// ===== Lưu trễ, gộp thay đổi =====
+// set()/setBandCut()/đổi profile chỉ công bố trong RAM rồi đánh dấu bẩn; task "cfgsave" ghi flash khi
+// cấu hình đứng yên SAVE_QUIET_MS (kéo slider = một lần ghi), muộn nhất SAVE_MAX_MS sau thay đổi đầu.
+static constexpr uint32_t SAVE_QUIET_MS = 1000;
+static constexpr uint32_t SAVE_MAX_MS   = 5000;
+static constexpr uint8_t  DIRTY_META    = 1u << P;   // bit P: tên / profile đang chọn
+static TaskHandle_t   s_saver = nullptr;
+static volatile uint8_t  s_dirty = 0;                // bit j: profile j
+static volatile bool     s_saving = false;
+static volatile uint8_t  s_want = 0xFF;              // đổi profile bị hoãn (bên ghi khác đang giữ khóa)
+static volatile uint32_t s_firstDirty = 0, s_lastDirty = 0;
+static CFG::SaveStats s_sv{};
+static QSConfig       s_snap[P];    // bản chép để ghi ngoài khóa
+static ProfMeta       s_metaSnap;
+static std::atomic<uint32_t> s_bandReq[7];   // (profile << 16) | cut_ms, 0 = không có
+static CFG::SaveHook  s_hooks[4];
+static uint8_t        s_nHooks = 0;
+static volatile uint32_t s_flushReq = 0, s_flushDone = 0;   // flush() chờ một vòng lưu bắt đầu sau yêu cầu
+
+// Gọi khi đang giữ s_wlock
+static void markDirty(uint8_t mask){
+  const uint32_t now = millis();
+  s_lastDirty = now;
+  if (!s_dirty) s_firstDirty = now; else s_sv.coalesced++;
+  s_dirty |= mask;
+  if (s_saver) xTaskNotifyGive(s_saver);
+}
+
+static void commit(){
+  xSemaphoreTake(s_wlock, portMAX_DELAY);
+  const uint8_t m = s_dirty;
+  for (uint8_t j=0;j<P;j++) if (m & (1u << j)) s_snap[j] = current(j).cfg;   // ô hiện hành không đổi khi giữ s_wlock
+  if (m & DIRTY_META) s_metaSnap = s_meta;
+  s_dirty = 0; s_saving = true;
+  xSemaphoreGive(s_wlock);
+  const uint32_t t0 = millis();
+  bool wrote = false;
+  for (uint8_t j=0;j<P;j++) {
+    if (!(m & (1u << j))) continue;
+    const uint32_t seq = s_jr[j].seq;
+    if (!saveBlob(j, s_snap[j])) s_sv.errors++;
+    else wrote |= (s_jr[j].seq != seq);
+  }
+  if (m & DIRTY_META) {
+    if (prefs.putBytes("pmeta", &s_metaSnap, sizeof(s_metaSnap)) == sizeof(s_metaSnap)) wrote = true;
+    else s_sv.errors++;
+  }
+  if (wrote) { s_sv.writes++; s_sv.last_ms = millis() - t0; }
+  s_saving = false;
+}
 
+// Task cfgsave: áp các yêu cầu setBandCut (biên dịch + lật ô) vào profile lúc yêu cầu
+static void applyBandReqs(){
+  uint32_t r[7]; bool any = false;
+  for (uint8_t b=0;b<7;b++) { r[b] = s_bandReq[b].exchange(0, std::memory_order_acquire); any |= r[b] != 0; }
+  if (!any) return;
+  writeBegin(true);
+  for (uint8_t j=0;j<P;j++) {
+    CtrlParams &nx = spare(j);
+    bool ch = false;
+    for (uint8_t b=0;b<7;b++) {
+      if (!r[b] || (r[b] >> 16) != j) continue;
+      if (!ch) { nx.cfg = current(j).cfg; ch = true; }
+      nx.cfg.map[b].cut_ms = (uint16_t)r[b];
+    }
+    if (!ch || memcmp(&nx.cfg, &current(j).cfg, sizeof(QSConfig)) == 0) continue;
+    flip(j);
+    if (j == s_active) publishActive();
+    markDirty(1u << j);
+  }
+  xSemaphoreGive(s_wlock);
+}
+
+static void selectNow(uint8_t i){
+  s_want = 0xFF;
+  if (i == s_active) return;
+  s_active = i; s_meta.active = i;
+  publishActive();
+  markDirty(DIRTY_META);
+}
+
+static void saver(void*){
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, s_dirty ? pdMS_TO_TICKS(50) : portMAX_DELAY);
+    const uint32_t req = s_flushReq;
+    const uint8_t w = s_want;
+    if (w < P) { xSemaphoreTake(s_wlock, portMAX_DELAY); selectNow(w); xSemaphoreGive(s_wlock); }
+    applyBandReqs();
+    for (uint8_t i=0;i<s_nHooks;i++) s_hooks[i]();
+    const uint32_t now = millis();
+    if (s_dirty && (now - s_lastDirty >= SAVE_QUIET_MS || now - s_firstDirty >= SAVE_MAX_MS)) commit();
+    s_flushDone = req;
+  }
+}
+
+// Bản cũ lưu mỗi trường một khóa trong namespace "qs": chỉ còn đọc để chuyển sang blob.
+// Chỉ các khóa firmware cũ thực sự đã ghi; trường thêm sau đó chỉ có trong blob (giữ mặc định).
+static void loadLegacy(Preferences &lp, QSConfig &g_cfg){
   // ==== Load các khóa cũ (giữ nguyên phần bạn đã có) ====
-  g_cfg.mode              = (Mode)prefs.getUChar("mode", (uint8_t)g_cfg.mode);
-  g_cfg.rpm_source        = (RpmSource)prefs.getUChar("rsrc", (uint8_t)g_cfg.rpm_source);
-  g_cfg.ppr               = prefs.getFloat("ppr", g_cfg.ppr);
-  g_cfg.rpm_min           = prefs.getUShort("rpmmin", g_cfg.rpm_min);
-  g_cfg.manual_kill_ms    = prefs.getUShort("mkill", g_cfg.manual_kill_ms);
-  g_cfg.debounce_shift_ms = prefs.getUShort("deb", g_cfg.debounce_shift_ms);
-  g_cfg.holdoff_ms        = prefs.getUShort("hold", g_cfg.holdoff_ms);
-  g_cfg.cut_output        = (CutOutputSel)prefs.getUChar("cout", (uint8_t)g_cfg.cut_output);
-  g_cfg.ap_timeout_s      = prefs.getUShort("ap_t", g_cfg.ap_timeout_s);
-  g_cfg.rpm_scale         = prefs.getFloat("rpm_s", g_cfg.rpm_scale);
+  g_cfg.mode              = (Mode)lp.getUChar("mode", (uint8_t)g_cfg.mode);
+  g_cfg.rpm_source        = (RpmSource)lp.getUChar("rsrc", (uint8_t)g_cfg.rpm_source);
+  g_cfg.ppr               = lp.getFloat("ppr", g_cfg.ppr);
+  g_cfg.rpm_min           = lp.getUShort("rpmmin", g_cfg.rpm_min);
+  g_cfg.manual_kill_ms    = lp.getUShort("mkill", g_cfg.manual_kill_ms);
+  g_cfg.debounce_shift_ms = lp.getUShort("deb", g_cfg.debounce_shift_ms);
+  g_cfg.holdoff_ms        = lp.getUShort("hold", g_cfg.holdoff_ms);
+  g_cfg.cut_output        = (CutOutputSel)lp.getUChar("cout", (uint8_t)g_cfg.cut_output);
+  g_cfg.ap_timeout_s      = lp.getUShort("ap_t", g_cfg.ap_timeout_s);
+  g_cfg.rpm_scale         = lp.getFloat("rpm_s", g_cfg.rpm_scale);
   // Load map_count (number of valid bands)
-  g_cfg.map_count         = prefs.getUChar("mcount", g_cfg.map_count);
+  g_cfg.map_count         = lp.getUChar("mcount", g_cfg.map_count);
   if (g_cfg.map_count == 0) g_cfg.map_count = 1; // at least one band
   if (g_cfg.map_count > 7)  g_cfg.map_count = 7;
 
   // ==== Load Wi-Fi AP config ====
   {
-    String s = prefs.getString("ap_ssid", String(g_cfg.ap_ssid));
-    String p = prefs.getString("ap_pass", String(g_cfg.ap_pass));
+    String s = lp.getString("ap_ssid", String(g_cfg.ap_ssid));
+    String p = lp.getString("ap_pass", String(g_cfg.ap_pass));
     s.toCharArray(g_cfg.ap_ssid, sizeof(g_cfg.ap_ssid));
     p.toCharArray(g_cfg.ap_pass, sizeof(g_cfg.ap_pass));
   }
@@ -35,175 +285,325 @@ void CFG::begin(){
   // ==== Load Auto Map (giữ nguyên) ====
   for (uint8_t i=0;i<7;i++){
     char key[8];
-    snprintf(key, sizeof(key), "m%dl", i); g_cfg.map[i].rpm_lo = prefs.getUShort(key, g_cfg.map[i].rpm_lo);
-    snprintf(key, sizeof(key), "m%dh", i); g_cfg.map[i].rpm_hi = prefs.getUShort(key, g_cfg.map[i].rpm_hi);
-    snprintf(key, sizeof(key), "m%dt", i); g_cfg.map[i].cut_ms  = prefs.getUShort(key, g_cfg.map[i].cut_ms);
+    snprintf(key, sizeof(key), "m%dl", i); g_cfg.map[i].rpm_lo = lp.getUShort(key, g_cfg.map[i].rpm_lo);
+    snprintf(key, sizeof(key), "m%dh", i); g_cfg.map[i].rpm_hi = lp.getUShort(key, g_cfg.map[i].rpm_hi);
+    snprintf(key, sizeof(key), "m%dt", i); g_cfg.map[i].cut_ms  = lp.getUShort(key, g_cfg.map[i].cut_ms);
   }
 
   // ==== Load Backfire (KHÓA MỚI bf_*) ====
-  g_cfg.bf_enable        = prefs.getUChar ("bfE",    g_cfg.bf_enable);
-  g_cfg.bf_ign_only      = prefs.getUChar ("bfIGN",  g_cfg.bf_ign_only);
-  g_cfg.bf_mode          = prefs.getUChar ("bfM",    g_cfg.bf_mode);
-  g_cfg.bf_rpm_min       = prefs.getUShort("bfRmin", g_cfg.bf_rpm_min);
-  g_cfg.bf_rpm_max       = prefs.getUShort("bfRmax", g_cfg.bf_rpm_max);
-  g_cfg.bf_warmup_s      = prefs.getUShort("bfWarm", g_cfg.bf_warmup_s);
-  g_cfg.bf_decel_thresh  = prefs.getUShort("bfDth",  g_cfg.bf_decel_thresh);
-  g_cfg.bf_window_ms     = prefs.getUShort("bfWin",  g_cfg.bf_window_ms);
-  g_cfg.bf_burst_count   = prefs.getUChar ("bfCnt",  g_cfg.bf_burst_count);
-  g_cfg.bf_burst_on      = prefs.getUShort("bfOn",   g_cfg.bf_burst_on);
-  g_cfg.bf_burst_off     = prefs.getUShort("bfOff",  g_cfg.bf_burst_off);
-  g_cfg.bf_refractory_ms = prefs.getUShort("bfRef",  g_cfg.bf_refractory_ms);
+  g_cfg.bf_enable        = lp.getUChar ("bfE",    g_cfg.bf_enable);
+  g_cfg.bf_ign_only      = lp.getUChar ("bfIGN",  g_cfg.bf_ign_only);
+  g_cfg.bf_mode          = lp.getUChar ("bfM",    g_cfg.bf_mode);
+  g_cfg.bf_rpm_min       = lp.getUShort("bfRmin", g_cfg.bf_rpm_min);
+  g_cfg.bf_rpm_max       = lp.getUShort("bfRmax", g_cfg.bf_rpm_max);
+  g_cfg.bf_warmup_s      = lp.getUShort("bfWarm", g_cfg.bf_warmup_s);
+  g_cfg.bf_decel_thresh  = lp.getUShort("bfDth",  g_cfg.bf_decel_thresh);
+  g_cfg.bf_window_ms     = lp.getUShort("bfWin",  g_cfg.bf_window_ms);
+  g_cfg.bf_burst_count   = lp.getUChar ("bfCnt",  g_cfg.bf_burst_count);
+  g_cfg.bf_burst_on      = lp.getUShort("bfOn",   g_cfg.bf_burst_on);
+  g_cfg.bf_burst_off     = lp.getUShort("bfOff",  g_cfg.bf_burst_off);
+  g_cfg.bf_refractory_ms = lp.getUShort("bfRef",  g_cfg.bf_refractory_ms);
 
   // ==== Load Lock config (mới) ====
-  g_cfg.lock_enabled       = prefs.getBool ("lk_en",  g_cfg.lock_enabled);
-  g_cfg.lock_cut_sel       = (CutOutputSel)prefs.getUChar("lk_cut", (uint8_t)g_cfg.lock_cut_sel);
+  g_cfg.lock_enabled       = lp.getBool ("lk_en",  g_cfg.lock_enabled);
+  g_cfg.lock_cut_sel       = (CutOutputSel)lp.getUChar("lk_cut", (uint8_t)g_cfg.lock_cut_sel);
   {
-    String lc = prefs.getString("lk_code", String(g_cfg.lock_code));
+    String lc = lp.getString("lk_code", String(g_cfg.lock_code));
     lc.toCharArray(g_cfg.lock_code, sizeof(g_cfg.lock_code));
   }
-  g_cfg.lock_short_ms_max  = prefs.getUShort("lk_smax", g_cfg.lock_short_ms_max);
-  g_cfg.lock_long_ms_min   = prefs.getUShort("lk_lmin", g_cfg.lock_long_ms_min);
-  g_cfg.lock_gap_ms        = prefs.getUShort("lk_gap",  g_cfg.lock_gap_ms);
-  g_cfg.lock_timeout_s     = prefs.getUShort("lk_tout", g_cfg.lock_timeout_s);
-  g_cfg.lock_max_retries   = prefs.getUChar ("lk_maxr", g_cfg.lock_max_retries);
-}
-
-const QSConfig& CFG::get(){ return g_cfg; }
+  g_cfg.lock_short_ms_max  = lp.getUShort("lk_smax", g_cfg.lock_short_ms_max);
+  g_cfg.lock_long_ms_min   = lp.getUShort("lk_lmin", g_cfg.lock_long_ms_min);
+  g_cfg.lock_gap_ms        = lp.getUShort("lk_gap",  g_cfg.lock_gap_ms);
+  g_cfg.lock_timeout_s     = lp.getUShort("lk_tout", g_cfg.lock_timeout_s);
+  g_cfg.lock_max_retries   = lp.getUChar ("lk_maxr", g_cfg.lock_max_retries);
 
+}
 
-void CFG::set(const QSConfig &c){
-  g_cfg = c;
-
-  // ==== Save các khóa cũ (giữ nguyên) ====
-  prefs.putUChar ("mode", (uint8_t)c.mode);
-  prefs.putUChar ("rsrc", (uint8_t)c.rpm_source);
-  prefs.putFloat ("ppr",  c.ppr);
-  prefs.putUShort("rpmmin", c.rpm_min);
-  prefs.putUShort("mkill",  c.manual_kill_ms);
-  prefs.putUShort("deb",    c.debounce_shift_ms);
-  prefs.putUShort("hold",   c.holdoff_ms);
-  prefs.putUChar ("cout", (uint8_t)c.cut_output);
-  prefs.putUShort("ap_t",  c.ap_timeout_s);
-  prefs.putFloat ("rpm_s", c.rpm_scale);
-
-  // Wi-Fi AP config
-  prefs.putString("ap_ssid", String(c.ap_ssid));
-  prefs.putString("ap_pass", String(c.ap_pass));
-
-  // Save up to 7; map_count indicates how many are valid (>0)
-  for (uint8_t i=0;i<7;i++){
-    char key[8];
-    snprintf(key, sizeof(key), "m%dl", i); prefs.putUShort(key, c.map[i].rpm_lo);
-    snprintf(key, sizeof(key), "m%dh", i); prefs.putUShort(key, c.map[i].rpm_hi);
-    snprintf(key, sizeof(key), "m%dt", i); prefs.putUShort(key, c.map[i].cut_ms);
+void CFG::begin(){
+  if (!s_wlock) s_wlock = xSemaphoreCreateMutex();
+  prefs.begin("qscfg", false);
+  if (prefs.getBytes("pmeta", &s_metaSnap, sizeof(s_metaSnap)) == sizeof(s_metaSnap)) {
+    s_meta = s_metaSnap;
+    for (uint8_t j=0;j<P;j++) s_meta.name[j][PROFILE_NAME_LEN-1] = 0;
   }
-  // Persist number of bands (map_count)
-  uint8_t cnt = c.map_count;
-  if (cnt == 0 || cnt > 7) {
-    cnt = 0;
-    for (uint8_t i=0;i<7;i++){
-      if (c.map[i].rpm_lo || c.map[i].rpm_hi || c.map[i].cut_ms) cnt++;
+  s_active = s_meta.active < P ? s_meta.active : 0;
+
+  // nạp thẳng vào ô dự phòng (chưa ai đọc), flip() biên dịch; publishActive() công bố
+  for (uint8_t j=0;j<P;j++) {
+    QSConfig &g_cfg = spare(j).cfg;
+    if (loadBlob(j, g_cfg)) {
+      if (!s_jr[j].ok) saveBlob(j, g_cfg);   // blob v1 / ngắn hơn: ghi lại một lần theo schema hiện tại
+    } else if (j == 0) {
+      // chưa có blob (hoặc hỏng/khác schema): đọc các khóa cũ, ghi blob, rồi xóa namespace cũ
+      Preferences lp;
+      const bool had = lp.begin("qs", true);
+      if (had) { loadLegacy(lp, g_cfg); lp.end(); }
+      sanitize(g_cfg);
+      if (saveBlob(0, g_cfg) && had && lp.begin("qs", false)) { lp.clear(); lp.end(); }
+    } else {
+      g_cfg = current(0).cfg;               // profile chưa lưu: bắt đầu từ profile 0
+      saveBlob(j, g_cfg);
     }
-    if (cnt == 0) cnt = 1;
+    flip(j);
   }
-  prefs.putUChar("mcount", cnt);
-
-  // ==== Save Backfire (bf_*) ====
-  prefs.putUChar ("bfE",    c.bf_enable);
-  prefs.putUChar ("bfIGN",  c.bf_ign_only);
-  prefs.putUChar ("bfM",    c.bf_mode);
-  prefs.putUShort("bfRmin", c.bf_rpm_min);
-  prefs.putUShort("bfRmax", c.bf_rpm_max);
-  prefs.putUShort("bfWarm", c.bf_warmup_s);
-  prefs.putUShort("bfDth",  c.bf_decel_thresh);
-  prefs.putUShort("bfWin",  c.bf_window_ms);
-  prefs.putUChar ("bfCnt",  c.bf_burst_count);
-  prefs.putUShort("bfOn",   c.bf_burst_on);
-  prefs.putUShort("bfOff",  c.bf_burst_off);
-  prefs.putUShort("bfRef",  c.bf_refractory_ms);
-
-  // Lock config
-  prefs.putBool ("lk_en",   c.lock_enabled);
-  prefs.putUChar("lk_cut",  (uint8_t)c.lock_cut_sel);
-  prefs.putString("lk_code", String(c.lock_code));
-  prefs.putUShort("lk_smax", c.lock_short_ms_max);
-  prefs.putUShort("lk_lmin", c.lock_long_ms_min);
-  prefs.putUShort("lk_gap",  c.lock_gap_ms);
-  prefs.putUShort("lk_tout", c.lock_timeout_s);
-  prefs.putUChar ("lk_maxr", c.lock_max_retries);
+  // cấu hình thiết bị theo profile đang chọn
+  for (uint8_t j=0;j<P;j++) {
+    if (j == s_active) continue;
+    spare(j).cfg = current(j).cfg;
+    copyGlobals(spare(j).cfg, current(s_active).cfg);
+    if (memcmp(&spare(j).cfg, &current(j).cfg, sizeof(QSConfig)) == 0) continue;
+    flip(j);
+    saveBlob(j, current(j).cfg);
+  }
+  publishActive();
+  if (!s_saver) xTaskCreate(saver, "cfgsave", 4096, nullptr, 1, &s_saver);
 }
 
-bool CFG::exportJSON(String &out){
-  StaticJsonDocument<1536> d;
-
-  // ==== Xuất khóa cũ (giữ nguyên) ====
-  d["mode"]               = (uint8_t)g_cfg.mode;
-  d["rpm_source"]         = (uint8_t)g_cfg.rpm_source;
-  d["ppr"]                = g_cfg.ppr;
-  d["rpm_min"]            = g_cfg.rpm_min;
-  d["manual_kill_ms"]     = g_cfg.manual_kill_ms;
-  d["debounce_shift_ms"]  = g_cfg.debounce_shift_ms;
-  d["holdoff_ms"]         = g_cfg.holdoff_ms;
-  d["cut_output"]         = (uint8_t)g_cfg.cut_output;
-  d["ap_timeout_s"]       = g_cfg.ap_timeout_s;
-  d["rpm_scale"]          = g_cfg.rpm_scale;
-
-  // Optionally export masked Wi-Fi info
-  d["ap_ssid"]            = String(g_cfg.ap_ssid);
-  d["ap_pass_len"]        = (uint8_t)strlen(g_cfg.ap_pass);
-
-  // ==== Xuất Backfire (bf_*) ====
-  d["bf_enable"]          = g_cfg.bf_enable;
-  d["bf_ign_only"]        = g_cfg.bf_ign_only;
-  d["bf_mode"]            = g_cfg.bf_mode;
-  d["bf_rpm_min"]         = g_cfg.bf_rpm_min;
-  d["bf_rpm_max"]         = g_cfg.bf_rpm_max;
-  d["bf_warmup_s"]        = g_cfg.bf_warmup_s;
-  d["bf_decel_thresh"]    = g_cfg.bf_decel_thresh;
-  d["bf_window_ms"]       = g_cfg.bf_window_ms;
-  d["bf_burst_count"]     = g_cfg.bf_burst_count;
-  d["bf_burst_on"]        = g_cfg.bf_burst_on;
-  d["bf_burst_off"]       = g_cfg.bf_burst_off;
-  d["bf_refractory_ms"]   = g_cfg.bf_refractory_ms;
-
-  // ==== Export Lock config ====
-  d["lock_enabled"]        = g_cfg.lock_enabled;
-  d["lock_cut_sel"]        = (uint8_t)g_cfg.lock_cut_sel;
-  d["lock_short_ms_max"]   = g_cfg.lock_short_ms_max;
-  d["lock_long_ms_min"]    = g_cfg.lock_long_ms_min;
-  d["lock_gap_ms"]         = g_cfg.lock_gap_ms;
-  d["lock_timeout_s"]      = g_cfg.lock_timeout_s;
-  d["lock_max_retries"]    = g_cfg.lock_max_retries;
+const CtrlParams& CFG::params(){ return *s_pub.load(std::memory_order_acquire); }
+const QSConfig& CFG::get(){ return params().cfg; }
+uint32_t CFG::gen(){ return s_pubGen.load(std::memory_order_acquire); }
 
-  // ==== Map ====
-  JsonArray m = d.createNestedArray("map");
-  for (uint8_t i=0;i<min<uint8_t>(g_cfg.map_count, (uint8_t)7); i++){
-    JsonObject o = m.createNestedObject();
-    o["lo"] = g_cfg.map[i].rpm_lo;
-    o["hi"] = g_cfg.map[i].rpm_hi;
-    o["t"]  = g_cfg.map[i].cut_ms;
+void CFG::snapshot(Snapshot &out){
+  xSemaphoreTake(s_wlock, portMAX_DELAY);
+  const CtrlParams &p = current(s_active);
+  out.cfg = p.cfg; out.gen = p.gen; out.map_status = p.map.status;
+  xSemaphoreGive(s_wlock);
+}
+
+QSConfig CFG::snapshot(){
+  xSemaphoreTake(s_wlock, portMAX_DELAY);
+  const QSConfig c = current(s_active).cfg;
+  xSemaphoreGive(s_wlock);
+  return c;
+}
+
+void CFG::quiescent(){
+  s_reader = true;
+  s_qs.fetch_add(1, std::memory_order_release);
+}
+
+bool CFG::setBandCut(uint8_t band, uint16_t cut_ms){
+  if (band >= 7 || !cut_ms) return false;
+  s_bandReq[band].store(((uint32_t)s_active << 16) | cut_ms, std::memory_order_release);
+  kick();
+  return true;
+}
+
+
+void CFG::set(const QSConfig &c){
+  writeBegin(true);
+  spare(s_active).cfg = c;
+  flip(s_active);
+  publishActive();
+  uint8_t m = 1u << s_active;
+  // cấu hình thiết bị đổi thì chép sang mọi profile (ô dự phòng của profile không chọn không ai đọc)
+  for (uint8_t j=0;j<P;j++) {
+    if (j == s_active) continue;
+    spare(j).cfg = current(j).cfg;
+    copyGlobals(spare(j).cfg, c);
+    if (memcmp(&spare(j).cfg, &current(j).cfg, sizeof(QSConfig)) == 0) continue;
+    flip(j);
+    m |= 1u << j;
   }
+  markDirty(m);
+  xSemaphoreGive(s_wlock);
+}
+
+uint8_t CFG::profile(){ return s_active; }
+
+void CFG::selectProfile(uint8_t i){
+  if (i >= P) return;
+  // Chỉ đổi con trỏ, không biên dịch/ghi flash; bên ghi khác đang giữ khóa -> task lưu làm giúp
+  if (xSemaphoreTake(s_wlock, 0) == pdTRUE) { selectNow(i); xSemaphoreGive(s_wlock); }
+  else { s_want = i; if (s_saver) xTaskNotifyGive(s_saver); }
+}
+
+const char* CFG::profileName(uint8_t i){ return i < P ? s_meta.name[i] : ""; }
 
-  serializeJsonPretty(d, out);
+void CFG::setProfileName(uint8_t i, const char *name){
+  if (i >= P || !name) return;
+  xSemaphoreTake(s_wlock, portMAX_DELAY);
+  strlcpy(s_meta.name[i], name, PROFILE_NAME_LEN);
+  markDirty(DIRTY_META);
+  xSemaphoreGive(s_wlock);
+}
+
+void CFG::copyProfile(uint8_t to){
+  if (to >= P || to == s_active) return;
+  writeBegin(true);
+  spare(to).cfg = current(s_active).cfg;
+  flip(to);
+  markDirty(1u << to);
+  xSemaphoreGive(s_wlock);
+}
+
+void CFG::addSaveHook(SaveHook fn){
+  if (fn && s_nHooks < sizeof(s_hooks) / sizeof(s_hooks[0])) s_hooks[s_nHooks++] = fn;
+}
+
+void CFG::kick(){ if (s_saver) xTaskNotifyGive(s_saver); }
+
+bool CFG::flush(uint32_t timeout_ms){
+  const uint32_t t0 = millis();
+  if (!s_saver) return true;
+  if (s_dirty) s_firstDirty = t0 - SAVE_MAX_MS;
+  // chờ một vòng lưu trọn vẹn sau yêu cầu này: hook (GEAR...) cũng kịp ghi
+  const uint32_t req = ++s_flushReq;
+  xTaskNotifyGive(s_saver);
+  while (s_dirty || s_saving || (int32_t)(s_flushDone - req) < 0) {
+    if (millis() - t0 > timeout_ms) return false;
+    delay(5);
+  }
   return true;
 }
 
+CFG::SaveStats CFG::saveStats(){
+  SaveStats s = s_sv;
+  s.pending = s_dirty || s_saving;
+  return s;
+}
+
+// Mỗi case một đơn vị (< JSONS::STAGE byte); khóa và thứ tự giữ như bản ArduinoJson cũ
+bool CFG::exportJSON(JSONS::Writer &w, const QSConfig &c, uint8_t prof, uint32_t step){
+  switch (step) {
+  case 0:
+    // ==== Xuất khóa cũ (giữ nguyên) ====
+    w.obj();
+    w.kv("mode",              (uint8_t)c.mode);
+    w.kv("rpm_source",        (uint8_t)c.rpm_source);
+    w.kv("rpm_backend",       (uint8_t)c.rpm_backend);
+    w.kv("inj_active_low",    c.inj_active_low);
+    w.kv("ppr",               c.ppr);
+    w.kv("rpm_avg_n",         c.rpm_avg_n);
+    w.kv("rpm_filter",        c.rpm_filter);
+    w.kv("trk_alpha",         c.trk_alpha);
+    w.kv("trk_beta",          c.trk_beta);
+    w.kv("rpm_min",           c.rpm_min);
+    w.kv("manual_kill_ms",    c.manual_kill_ms);
+    w.kv("debounce_shift_ms", c.debounce_shift_ms);
+    w.kv("holdoff_ms",        c.holdoff_ms);
+    w.kv("trig_fast",         c.trig_fast);
+    return true;
+  case 1:
+    w.kv("at_enable",         c.at_enable);
+    w.kv("at_margin_ms",      c.at_margin_ms);
+    w.kv("cut_output",        (uint8_t)c.cut_output);
+    w.kv("cut_mode",          (uint8_t)c.cut_mode);
+    w.kv("cut_sparks",        c.cut_sparks);
+    w.arr("prog_pct");
+    for (uint8_t i=0;i<min<uint8_t>(c.prog_n, PROG_PTS);i++) w.val(c.prog_pct[i]);
+    w.end();
+    w.kv("ap_timeout_s",      c.ap_timeout_s);
+    w.kv("rpm_scale",         c.rpm_scale);
+    return true;
+  case 2:
+    // Optionally export masked Wi-Fi info
+    w.kv("ap_ssid",           c.ap_ssid);
+    w.kv("ap_pass_len",       (uint8_t)strlen(c.ap_pass));
+    return true;
+  case 3:
+    // ==== Xuất Backfire (bf_*) ====
+    w.kv("bf_enable",         c.bf_enable);
+    w.kv("bf_ign_only",       c.bf_ign_only);
+    w.kv("bf_mode",           c.bf_mode);
+    w.kv("bf_rpm_min",        c.bf_rpm_min);
+    w.kv("bf_rpm_max",        c.bf_rpm_max);
+    w.kv("bf_warmup_s",       c.bf_warmup_s);
+    w.kv("bf_decel_thresh",   c.bf_decel_thresh);
+    w.kv("bf_window_ms",      c.bf_window_ms);
+    w.kv("bf_burst_count",    c.bf_burst_count);
+    w.kv("bf_burst_on",       c.bf_burst_on);
+    w.kv("bf_burst_off",      c.bf_burst_off);
+    w.kv("bf_refractory_ms",  c.bf_refractory_ms);
+    w.kv("bf_skip_sparks",    c.backfire.skip_sparks);
+    return true;
+  case 4:
+    // ==== Export Lock config ====
+    w.kv("lock_enabled",      c.lock_enabled);
+    w.kv("lock_cut_sel",      (uint8_t)c.lock_cut_sel);
+    w.kv("lock_short_ms_max", c.lock_short_ms_max);
+    w.kv("lock_long_ms_min",  c.lock_long_ms_min);
+    w.kv("lock_gap_ms",       c.lock_gap_ms);
+    w.kv("lock_timeout_s",    c.lock_timeout_s);
+    w.kv("lock_max_retries",  c.lock_max_retries);
+    w.kv("prof_gesture",      c.prof_gesture);
+    w.kv("tele_hz",           c.tele_hz);
+    w.kv("profile",           prof);
+    return true;
+  case 5:
+    // ==== Map ====
+    w.arr("map");
+    for (uint8_t i=0;i<min<uint8_t>(c.map_count, (uint8_t)7); i++){
+      w.obj();
+      w.kv("lo", c.map[i].rpm_lo);
+      w.kv("hi", c.map[i].rpm_hi);
+      w.kv("t",  c.map[i].cut_ms);
+      w.end();
+    }
+    w.end();
+    return true;
+  case 6: {
+    // ==== Map 2D ==== (bảng t: mỗi hàng một đơn vị)
+    const CutMap2D &m2 = c.map2d;
+    w.obj("map2d");
+    w.kv("en",   m2.enabled);
+    w.kv("ysrc", (uint8_t)m2.y_src);
+    w.arr("x");
+    for (uint8_t i=0;i<min(m2.nx, MAP2D_X);i++) w.val(m2.x_rpm[i]);
+    w.end();
+    w.arr("y");
+    for (uint8_t j=0;j<min(m2.ny, MAP2D_Y);j++) w.val(m2.y_val[j]);
+    w.end();
+    w.arr("t");
+    return true;
+  }
+  default: {
+    const CutMap2D &m2 = c.map2d;
+    const uint32_t j = step - 7;
+    if (j < min(m2.ny, MAP2D_Y)) {
+      w.arr();
+      for (uint8_t i=0;i<min(m2.nx, MAP2D_X);i++) w.val(m2.cut_ms[j][i]);
+      w.end();
+      return true;
+    }
+    w.end(); w.end(); w.end();   // t, map2d, gốc
+    return false;
+  }
+  }
+}
+
 bool CFG::importJSON(const String &in){
   StaticJsonDocument<2048> d;
   auto err = deserializeJson(d, in);
   if (err) return false;
 
-  QSConfig c = g_cfg; // bắt đầu từ cấu hình hiện tại
+  QSConfig c = CFG::snapshot(); // bắt đầu từ cấu hình hiện tại (gọi từ web)
 
   // ==== Nhận khóa cũ (giữ nguyên) ====
   if (d.containsKey("mode"))               c.mode = (Mode)(uint8_t)d["mode"].as<uint8_t>();
   if (d.containsKey("rpm_source"))         c.rpm_source = (RpmSource)(uint8_t)d["rpm_source"].as<uint8_t>();
+  if (d.containsKey("rpm_backend"))        c.rpm_backend = d["rpm_backend"].as<uint8_t>() ? RpmBackend::RMT : RpmBackend::GPIO;
+  if (d.containsKey("inj_active_low"))     c.inj_active_low = d["inj_active_low"].as<uint8_t>() ? 1 : 0;
   if (d.containsKey("ppr"))                c.ppr = d["ppr"].as<float>();
+  if (d.containsKey("rpm_avg_n"))          c.rpm_avg_n = constrain(d["rpm_avg_n"].as<uint8_t>(), (uint8_t)1, (uint8_t)16);
+  if (d.containsKey("rpm_filter"))         c.rpm_filter = d["rpm_filter"].as<uint8_t>() ? 1 : 0;
+  if (d.containsKey("trk_alpha"))          c.trk_alpha = d["trk_alpha"].as<uint8_t>();
+  if (d.containsKey("trk_beta"))           c.trk_beta = d["trk_beta"].as<uint8_t>();
   if (d.containsKey("rpm_min"))            c.rpm_min = d["rpm_min"].as<uint16_t>();
   if (d.containsKey("manual_kill_ms"))     c.manual_kill_ms = d["manual_kill_ms"].as<uint16_t>();
   if (d.containsKey("debounce_shift_ms"))  c.debounce_shift_ms = d["debounce_shift_ms"].as<uint16_t>();
   if (d.containsKey("holdoff_ms"))         c.holdoff_ms = d["holdoff_ms"].as<uint16_t>();
+  if (d.containsKey("trig_fast"))          c.trig_fast = d["trig_fast"].as<uint8_t>() ? 1 : 0;
+  if (d.containsKey("at_enable"))          c.at_enable = d["at_enable"].as<uint8_t>() ? 1 : 0;
+  if (d.containsKey("at_margin_ms"))       c.at_margin_ms = constrain(d["at_margin_ms"].as<uint8_t>(), (uint8_t)0, (uint8_t)30);
   if (d.containsKey("cut_output"))         c.cut_output = (CutOutputSel)(uint8_t)d["cut_output"].as<uint8_t>();
+  if (d.containsKey("cut_mode"))           c.cut_mode = (CutMode)min<uint8_t>(d["cut_mode"].as<uint8_t>(), (uint8_t)CutMode::PROG);
+  if (d.containsKey("cut_sparks"))         c.cut_sparks = constrain(d["cut_sparks"].as<uint8_t>(), (uint8_t)1, (uint8_t)64);
+  if (d.containsKey("prog_pct")){
+    uint8_t n = 0;
+    for (JsonVariant v : d["prog_pct"].as<JsonArray>()){ if (n >= PROG_PTS) break; c.prog_pct[n++] = min<uint8_t>(v.as<uint8_t>(), 100); }
+    if (n) c.prog_n = n;
+  }
   if (d.containsKey("ap_timeout_s"))       c.ap_timeout_s = d["ap_timeout_s"].as<uint16_t>();
   if (d.containsKey("rpm_scale"))          c.rpm_scale = d["rpm_scale"].as<float>();
 
@@ -230,6 +630,7 @@ bool CFG::importJSON(const String &in){
   if (d.containsKey("bf_burst_on"))        c.bf_burst_on      = d["bf_burst_on"].as<uint16_t>();
   if (d.containsKey("bf_burst_off"))       c.bf_burst_off     = d["bf_burst_off"].as<uint16_t>();
   if (d.containsKey("bf_refractory_ms"))   c.bf_refractory_ms = d["bf_refractory_ms"].as<uint16_t>();
+  if (d.containsKey("bf_skip_sparks"))     c.backfire.skip_sparks = constrain(d["bf_skip_sparks"].as<uint8_t>(), (uint8_t)0, (uint8_t)16);
 
   // ==== Lock config ====
   if (d.containsKey("lock_enabled"))        c.lock_enabled       = d["lock_enabled"].as<bool>();
@@ -252,6 +653,8 @@ bool CFG::importJSON(const String &in){
   if (d.containsKey("lock_gap_ms"))        c.lock_gap_ms        = d["lock_gap_ms"].as<uint16_t>();
   if (d.containsKey("lock_timeout_s"))     c.lock_timeout_s     = d["lock_timeout_s"].as<uint16_t>();
   if (d.containsKey("lock_max_retries"))   c.lock_max_retries   = d["lock_max_retries"].as<uint8_t>();
+  if (d.containsKey("prof_gesture"))       c.prof_gesture       = d["prof_gesture"].as<uint8_t>();
+  if (d.containsKey("tele_hz"))            c.tele_hz            = constrain(d["tele_hz"].as<uint8_t>(), (uint8_t)1, (uint8_t)50);
 
   // ==== Map ====
   if (d.containsKey("map")){
@@ -269,6 +672,36 @@ bool CFG::importJSON(const String &in){
       if (c.map[i].rpm_lo || c.map[i].rpm_hi || c.map[i].cut_ms) c.map_count++;
     }
     if (c.map_count==0) c.map_count = 1; // at least one band
+    // Từ chối map có dải đảo/chồng nhau; khoảng trống thì được nội suy
+    if (CMAP::validate(c) & CMAP::ERR_MASK) return false;
+  }
+
+  // ==== Map 2D ====
+  if (d.containsKey("map2d")){
+    JsonObject o = d["map2d"].as<JsonObject>();
+    CutMap2D &m2 = c.map2d;
+    if (o.containsKey("en"))   m2.enabled = o["en"].as<uint8_t>() ? 1 : 0;
+    if (o.containsKey("ysrc")) m2.y_src   = (MapYSrc)min<uint8_t>(o["ysrc"].as<uint8_t>(), (uint8_t)MapYSrc::LOAD);
+    if (o.containsKey("x")){
+      JsonArray x = o["x"].as<JsonArray>();
+      m2.nx = 0;
+      for (JsonVariant v : x){ if (m2.nx >= MAP2D_X) break; m2.x_rpm[m2.nx++] = v.as<uint16_t>(); }
+    }
+    if (o.containsKey("y")){
+      JsonArray y = o["y"].as<JsonArray>();
+      m2.ny = 0;
+      for (JsonVariant v : y){ if (m2.ny >= MAP2D_Y) break; m2.y_val[m2.ny++] = v.as<uint16_t>(); }
+    }
+    if (o.containsKey("t")){
+      uint8_t j = 0;
+      for (JsonArray row : o["t"].as<JsonArray>()){
+        if (j >= MAP2D_Y) break;
+        uint8_t i = 0;
+        for (JsonVariant v : row){ if (i >= MAP2D_X) break; m2.cut_ms[j][i++] = constrain(v.as<uint16_t>(), CUT_MS_MIN, CUT_MS_MAX); }
+        j++;
+      }
+    }
+    if (CMAP::validate(c) & CMAP::ERR_AXIS2D) return false;
   }
 
   CFG::set(c);
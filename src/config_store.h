@@ -1,15 +1,64 @@
 #pragma once
 #include "config.h"
+#include "cut_map.h"
+#include "json_stream.h"
+
+// Một phiên bản cấu hình đã biên dịch. Bất biến sau khi công bố: bên ghi dựng bản mới
+// ở ô dự phòng rồi đổi con trỏ (RCU), bên đọc chỉ đọc một con trỏ, không khóa, không chép.
+struct CtrlParams {
+  uint32_t gen;            // số phiên bản, tăng mỗi lần công bố
+  uint32_t rpm_k;          // 60e6 * rpm_scale / ppr: rpm = rpm_k / chu kỳ (µs)
+  CMAP::Compiled map;
+  QSConfig cfg;
+};
 
 namespace CFG {
   void begin();
-  const QSConfig& get();        // << đổi từ QSConfig get();
-  void set(const QSConfig &c);
-  bool exportJSON(String &out);
+  // Phiên bản đang công bố. Task điều khiển giữ tham chiếu trong một chu kỳ rồi gọi quiescent().
+  // Chỉ task điều khiển được giữ tham chiếu: task khác không nằm trong cơ chế quiescent.
+  const CtrlParams& params();
+  const QSConfig& get();        // = params().cfg
+  // Task khác (web async_tcp, loop): chép nguyên bản dưới khóa ghi. Bên ghi chỉ sửa ô dự phòng khi
+  // giữ khóa nên bản chép không bao giờ rách, dù ngay sau đó ô cũ bị dùng lại.
+  struct Snapshot { QSConfig cfg; uint32_t gen; uint8_t map_status; };
+  void snapshot(Snapshot &out);
+  QSConfig snapshot();
+  uint32_t gen();               // gen đang công bố (một từ atomic): rẻ để biết có cần chép lại không
+  void quiescent();             // task điều khiển: hết chu kỳ, không còn giữ bản cũ
+  void set(const QSConfig &c);  // công bố (chờ bản cũ hết người đọc); flash ghi sau, gộp bởi task "cfgsave"
+  // Profile (vd. street / track / rain): mỗi profile một QSConfig đã biên dịch sẵn trong RAM.
+  // Cấu hình thiết bị (cảm biến RPM, Wi-Fi, khóa) dùng chung, set() chép sang mọi profile.
+  static constexpr uint8_t PROFILES = 3;
+  static constexpr uint8_t PROFILE_NAME_LEN = 12;
+  uint8_t profile();
+  void selectProfile(uint8_t i);      // O(1): đổi con trỏ công bố, không biên dịch/ghi flash; an toàn từ task điều khiển
+  const char* profileName(uint8_t i);
+  void setProfileName(uint8_t i, const char *name);
+  void copyProfile(uint8_t to);       // chép profile đang chọn sang profile to
+  bool flush(uint32_t timeout_ms = 3000);   // ghi ngay phần còn chờ (trước khi reboot); false = hết giờ
+  // Ghi flash của module khác (vd. tỉ lệ số GEAR) chạy trong task "cfgsave" (ưu tiên 1), không trong
+  // task điều khiển. Mỗi lần task lưu thức dậy, mọi hook được gọi; hook tự xét cờ bẩn của mình.
+  using SaveHook = void (*)();
+  void addSaveHook(SaveHook fn);      // gọi lúc khởi động
+  void kick();                        // đánh thức task lưu (chỉ notify, an toàn từ task điều khiển)
+  struct SaveStats {
+    uint32_t writes;     // số lần ghi blob thật sự
+    uint32_t coalesced;  // thay đổi được gộp vào lần ghi sau
+    uint32_t errors;
+    uint32_t last_ms;    // thời gian lần ghi gần nhất
+    bool     pending;    // còn thay đổi chưa xuống flash
+  };
+  SaveStats saveStats();
+  // JSON cấu hình theo từng đơn vị cho JSONS::send; c = bản chụp bên gọi giữ tới hết response
+  bool exportJSON(JSONS::Writer &w, const QSConfig &c, uint8_t profile, uint32_t step);
   bool importJSON(const String &in);
+  // Hẹn ghi cut_ms của một dải AUTO (profile đang chọn). Chỉ ghi một ô atomic rồi đánh thức task
+  // "cfgsave"; biên dịch map, lật ô và lưu flash đều chạy ở đó, không trong task điều khiển.
+  // Yêu cầu sau cho cùng dải thay yêu cầu chưa áp. false = tham số sai.
+  bool setBandCut(uint8_t band, uint16_t cut_ms);
   // convenience: set only Wi-Fi credentials
   inline void setWifi(const char* ssid, const char* pass){
-    auto c = get();
+    auto c = snapshot();
     if (ssid) strncpy(c.ap_ssid, ssid, sizeof(c.ap_ssid));
     if (pass) strncpy(c.ap_pass, pass, sizeof(c.ap_pass));
     c.ap_ssid[sizeof(c.ap_ssid)-1] = '\0';
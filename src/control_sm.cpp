@@ -1,46 +1,171 @@
 #include "control_sm.h"
 #include "config_store.h"
 #include "rpm_rmt.h"
+#include "rpm_track.h"
 #include "trigger_input.h"
 #include "cut_output.h"
 #include "log_ring.h"
 #include "pins.h"
 #include "pwm_test.h"
 #include "lock_guard.h"
+#include "cut_map.h"
+#include "gear_est.h"
+#include "auto_tune.h"
 
 static State st = State::IDLE; static uint32_t tEntry=0; static uint16_t lastCut=0; static bool armedEdge=false;
 
-static uint16_t lookupCut(uint16_t rpm, const QSConfig &c){
+// Giá trị trục Y cho map 2D: số hiện tại từ GEAR (0 = chưa biết -> hàng đầu tiên),
+// hoặc tải = duty kim phun ‰ (0 khi nguồn RPM không phải kim phun)
+static uint16_t mapY(const QSConfig &c){
+  if (c.map2d.y_src == MapYSrc::GEAR) return GEAR::current();
+  if (c.map2d.y_src == MapYSrc::LOAD) return RPM::injDuty();
+  return 0;
+}
+
+static uint16_t lookupCut(uint16_t rpm, const CtrlParams &p){
   // manual
-  if (c.mode==Mode::MANUAL) return c.manual_kill_ms;
-  // auto (linear between bands)
-  for (uint8_t i=0;i<c.map_count;i++){
-    auto b=c.map[i];
-    if (rpm>=b.rpm_lo && rpm<b.rpm_hi) return b.cut_ms;
+  if (p.cfg.mode==Mode::MANUAL) return p.cfg.manual_kill_ms;
+  // auto 2D: RPM × Y, nội suy song tuyến
+  if (p.map.m2d_on) return CMAP::lookup2D(p.map, rpm, mapY(p.cfg));
+  // auto: bảng đã biên dịch (nội suy tuyến tính giữa tâm các dải)
+  return CMAP::lookup(p.map, rpm);
+}
+
+static uint16_t cutRpm=0; static bool cutBf=false; static const char* cutWhy="shift";
+
+// Mẫu lũy tiến dùng khi bắn (chép từ cfg trong planCut; patN = 0 -> cắt liền)
+static uint8_t patPct[PROG_PTS]; static volatile uint8_t patN = 0;
+
+// Tính thời gian cắt + line cho một lần sang số ở rpm hiện tại.
+// sparks > 0: cắt theo số chu kỳ đánh lửa, cut (ms) khi đó là ước lượng/dự phòng.
+static void planCut(uint16_t rpm, const CtrlParams &p, uint16_t &cut, uint8_t &sparks, bool &useIgn, bool &bf){
+  const QSConfig &cfg = p.cfg;
+  cut = lookupCut(rpm, p);
+  sparks = 0;
+  useIgn = (cfg.cut_output==CutOutputSel::IGN);
+  bf = false;
+  if (cfg.backfire_enabled && rpm >= cfg.backfire_min_rpm){
+    bf = true; useIgn = true; // force IGN to keep fuel flowing
+    cut = min<uint16_t>(CUT_MS_MAX, (uint16_t)(cut + cfg.backfire_extra_ms));
+  }
+  const uint32_t per = RPM::rpmToPeriod(rpm);
+  if (cfg.cut_mode != CutMode::MS && per) {
+    uint32_t k = cfg.cut_sparks;
+    if (bf) k += ((uint32_t)cfg.backfire_extra_ms * 1000UL + per - 1) / per;
+    // vẫn giữ trần cứng CUT_MS_MAX khi RPM thấp
+    k = constrain(k, (uint32_t)1, max<uint32_t>(1, (uint32_t)CUT_MS_MAX * 1000UL / per));
+    sparks = (uint8_t)min<uint32_t>(k, 255);
+    cut = (uint16_t)((sparks * per + 500) / 1000);
+    if (cfg.cut_mode == CutMode::PROG) {
+      const uint8_t n = constrain(cfg.prog_n, (uint8_t)1, PROG_PTS);
+      if (patN != n || memcmp(patPct, cfg.prog_pct, n)) { patN = 0; memcpy(patPct, cfg.prog_pct, n); patN = n; }
+    } else patN = 0;
+    return;
   }
-  // above last band: use last
-  return c.map[c.map_count-1].cut_ms;
+  cut = constrain(cut, CUT_MS_MIN, CUT_MS_MAX);
+}
+
+static void IRAM_ATTR fire(CutLine line, uint32_t us, uint8_t sparks){
+  if (sparks && patN) CUT::pulsePattern(CutOwner::QS, line, sparks, us, patPct, patN);
+  else if (sparks) CUT::pulseSparks(CutOwner::QS, line, sparks, us);
+  else        CUT::pulseUs(CutOwner::QS, line, us);
+}
+
+// ===== Fast path: ISR của TRIG bắn cắt trực tiếp =====
+// tick() chuẩn bị sẵn tham số cắt khi IDLE; ISR chỉ gọi CUT::pulseUs.
+// Tham số hết hạn nếu tick() ngừng làm mới (vd. đang khóa, loop bị chặn).
+static constexpr uint32_t FAST_VALID_US = 20000;
+static volatile bool     fastArmed = false;
+static volatile bool     fastFired = false;
+static volatile uint32_t fastValidUntil = 0;
+static volatile uint32_t fastCutUs = 0;
+static volatile CutLine  fastLine = CutLine::IGN;
+static volatile uint8_t  fastSparks = 0;
+static uint16_t fastCutMs=0, fastRpm=0; static bool fastBf=false;
+
+static void IRAM_ATTR onPressIsr(uint32_t t_us){
+  if (!fastArmed || (int32_t)(fastValidUntil - t_us) < 0) return;
+  fastArmed = false;
+  fire(fastLine, fastCutUs, fastSparks);
+  fastFired = true;
+}
+
+// Cạnh nhấn vừa bắn hóa ra là gai: bỏ cắt QS đang chạy, tick() không ghi nhận lần sang số
+static void IRAM_ATTR onPressGlitchIsr(){
+  CUT::flush(CutOwner::QS, fastLine);
+  fastFired = false;
 }
 
-static void pushLog(uint16_t rpm, uint16_t cut, bool autoMode, bool bf, CutOutputSel sel, const char* why){
-  LogItem it{}; it.ts_ms=millis(); it.rpm=rpm; it.cut_ms=cut; it.auto_mode=autoMode; it.backfire=bf; strncpy(it.out,(sel==CutOutputSel::IGN?"IGN":"INJ"),3); strncpy(it.reason, why, 7); LOGR::push(it);
+static void armFast(uint16_t rpm, const CtrlParams &p){
+  fastArmed = false;
+  if (!p.cfg.trig_fast || rpm < p.cfg.rpm_min) return;
+  uint16_t cut; uint8_t sparks; bool useIgn, bf;
+  planCut(rpm, p, cut, sparks, useIgn, bf);
+  fastCutMs = cut; fastRpm = rpm; fastBf = bf;
+  fastCutUs = (uint32_t)cut * 1000UL;
+  fastSparks = sparks;
+  fastLine  = useIgn? CutLine::IGN : CutLine::INJ;
+  fastValidUntil = micros() + FAST_VALID_US;
+  fastArmed = true;
 }
 
-void CTRL::begin(){ st=State::IDLE; tEntry=millis(); }
+// Auto-tune chỉ áp cho map 1D ở AUTO, cắt theo ms; bỏ qua cắt backfire (cố ý dài hơn)
+static void tuneCut(uint16_t rpm, uint16_t cut, bool bf, const CtrlParams &p){
+  const QSConfig &cfg = p.cfg;
+  if (!cfg.at_enable || cfg.mode != Mode::AUTO || cfg.cut_mode != CutMode::MS || p.map.m2d_on || bf) return;
+  ATUNE::onCut(rpm, cut);
+}
+
+static void pushLog(uint16_t rpm, uint16_t cut, uint32_t act_us, bool autoMode, bool bf, CutOutputSel sel, const char* why){
+  LogItem it{}; it.ts_ms=millis(); it.rpm=rpm; it.cut_ms=cut; it.act_us=act_us; it.auto_mode=autoMode; it.backfire=bf; it.load=RPM::injDuty(); strncpy(it.out,(sel==CutOutputSel::IGN?"IGN":"INJ"),3); strncpy(it.reason, why, 7); LOGR::push(it);
+}
+
+void CTRL::begin(){ st=State::IDLE; tEntry=millis(); TRIG::setPressHook(onPressIsr, onPressGlitchIsr); }
+
+void CTRL::update(){
+  const CtrlParams &p = CFG::params();
+  const QSConfig &cfg = p.cfg;
+
+  // Tham số dẫn xuất chỉ áp lại khi có phiên bản mới
+  static uint32_t gen = 0;
+  if (p.gen != gen) {
+    gen = p.gen;
+    RPM::setK(p.rpm_k);
+    RPM::setFilter(cfg.rpm_avg_n, cfg.rpm_filter != 0);
+    RPMTRK::setGains(cfg.trk_alpha, cfg.trk_beta);
+    TRIG::setDebounce(cfg.debounce_shift_ms);
+  }
+  RPMTRK::update();
+  GEAR::update();
+  ATUNE::update();
+}
 
 void CTRL::tick(){
 
-  QSConfig cfg = CFG::get();
+  // Phiên bản cấu hình đang công bố: chỉ đọc con trỏ, giữ tới hết chu kỳ (CFG::quiescent)
+  const CtrlParams &p = CFG::params();
+  const QSConfig &cfg = p.cfg;
 
-  // Update RPM helpers
-  RPM::setPPR(cfg.ppr); RPM::setScale(cfg.rpm_scale);
   const uint16_t rpm = RPM::get();PWMTEST::tick();
 
   // software tick for PWM test generator
 
   switch(st){
     case State::IDLE:
-      if (TRIG::pressed()) { st=State::ARMED; tEntry=millis(); armedEdge=true; }
+      if (fastFired) {
+        // ISR đã mở cắt; chỉ cần theo dõi tới khi nhả
+        fastFired=false; lastCut=fastCutMs; cutRpm=fastRpm; cutBf=fastBf; cutWhy="fshift";
+        GEAR::onCut();
+        tuneCut(fastRpm, fastCutMs, fastBf, p);
+        st=State::CUT; tEntry=millis();
+        break;
+      }
+      if (TRIG::pressed()) {
+        fastArmed=false;
+        if (!fastFired) { st=State::ARMED; tEntry=millis(); armedEdge=true; }
+        break;
+      }
+      armFast(rpm, p);
       break;
 
     case State::ARMED: {
@@ -48,25 +173,24 @@ void CTRL::tick(){
       if (!ok) { st=State::IDLE; break; }
       // proceed to CUT
       st=State::CUT; tEntry=millis();
-      uint16_t cut = lookupCut(rpm, cfg);
-      bool useIgn = (cfg.cut_output==CutOutputSel::IGN);
-      bool bf = false;
-      if (cfg.backfire_enabled && rpm >= cfg.backfire_min_rpm){
-        bf = true; useIgn = true; // force IGN to keep fuel flowing
-        cut = min<uint16_t>(CUT_MS_MAX, (uint16_t)(cut + cfg.backfire_extra_ms));
-      }
-      cut = constrain(cut, CUT_MS_MIN, CUT_MS_MAX);
-      // Do cut
-      CUT::set(useIgn? CutLine::IGN : CutLine::INJ, true); // open relay (cut)
-      delay(cut);
-      CUT::set(useIgn? CutLine::IGN : CutLine::INJ, false); // release
-      lastCut = cut;
-      pushLog(rpm, cut, cfg.mode==Mode::AUTO, bf, cfg.cut_output, "shift");
-      st=State::RECOVER; tEntry=millis();
+      uint16_t cut; uint8_t sparks; bool useIgn, bf;
+      planCut(rpm, p, cut, sparks, useIgn, bf);
+      // Do cut: esp_timer nhả relay, loop không bị chặn
+      fire(useIgn? CutLine::IGN : CutLine::INJ, (uint32_t)cut * 1000UL, sparks);
+      lastCut = cut; cutRpm = rpm; cutBf = bf; cutWhy = "shift";
+      GEAR::onCut();
+      tuneCut(rpm, cut, bf, p);
     } break;
 
+    case State::CUT:
+      if (!CUT::busy(CutOwner::QS)) {
+        pushLog(cutRpm, lastCut, CUT::lastActUs(CutOwner::QS), cfg.mode==Mode::AUTO, cutBf, cfg.cut_output, cutWhy);
+        st=State::RECOVER; tEntry=millis();
+      }
+      break;
+
     case State::RECOVER:
-      if ((millis()-tEntry) >= CFG::get().holdoff_ms) { st=State::IDLE; }
+      if ((millis()-tEntry) >= cfg.holdoff_ms) { st=State::IDLE; }
       break;
   }
  
@@ -5,5 +5,6 @@
 enum class State { IDLE=0, ARMED, CUT, RECOVER };
 namespace CTRL {
   void begin();
-  void tick(); // call in loop
+  void update(); // mỗi chu kỳ, kể cả khi khóa: tham số theo gen + RPMTRK/GEAR/ATUNE
+  void tick();   // máy trạng thái QS: chỉ khi không khóa
 }
@@ -0,0 +1,82 @@
+#include "ctrl_task.h"
+#include <atomic>
+
+static constexpr uint32_t STACK_BYTES = 8192;     // ATUNE phân tích vết trên stack
+static constexpr uint32_t LATE_US     = 100;
+static constexpr uint8_t  QLEN        = 16;       // lũy thừa của 2
+
+// Hàng đợi SPSC: chỉ producer ghi s_qt, chỉ consumer ghi s_qh
+static CTASK::Msg s_q[QLEN];
+static std::atomic<uint8_t> s_qh{0}, s_qt{0};
+
+static CTASK::StepFn s_step = nullptr;
+static CTASK::ExecFn s_exec = nullptr;
+static TaskHandle_t  s_task = nullptr;
+static CTASK::Stats  s_st{};
+static volatile bool s_reset = false;
+
+bool CTASK::post(const Msg &m){
+  const uint8_t t = s_qt.load(std::memory_order_relaxed);
+  if ((uint8_t)(t - s_qh.load(std::memory_order_acquire)) >= QLEN) { s_st.drops++; return false; }
+  s_q[t & (QLEN - 1)] = m;
+  s_qt.store((uint8_t)(t + 1), std::memory_order_release);
+  return true;
+}
+
+static void drain(){
+  uint8_t h = s_qh.load(std::memory_order_relaxed);
+  const uint8_t t = s_qt.load(std::memory_order_acquire);
+  while (h != t) {
+    const CTASK::Msg m = s_q[h & (QLEN - 1)];
+    h++;
+    s_qh.store(h, std::memory_order_release);
+    if (s_exec) s_exec(m);
+    s_st.cmds++;
+  }
+}
+
+static void run(void*){
+  const TickType_t period = pdMS_TO_TICKS(1) ? pdMS_TO_TICKS(1) : 1;   // Arduino: configTICK_RATE_HZ = 1000
+  TickType_t wake = xTaskGetTickCount();
+  uint32_t prev = micros();
+  for (;;) {
+    const uint32_t t0 = micros();
+    if (s_reset) { s_reset = false; const uint32_t d = s_st.drops; s_st = CTASK::Stats{}; s_st.drops = d; }
+    // jitter = lệch của khoảng cách hai lần thức so với chu kỳ
+    if (s_st.loops) {
+      const int32_t d = (int32_t)(t0 - prev) - (int32_t)CTASK::PERIOD_US;
+      const uint32_t jit = (uint32_t)(d < 0 ? -d : d);
+      if (jit > s_st.max_jitter_us) s_st.max_jitter_us = jit;
+      if (jit > LATE_US) s_st.late++;
+    }
+    prev = t0;
+
+    drain();
+    if (s_step) s_step();
+
+    const uint32_t ex = micros() - t0;
+    if (ex > s_st.max_exec_us) s_st.max_exec_us = ex;
+    s_st.avg_exec_us = s_st.loops ? s_st.avg_exec_us + (((int32_t)ex - (int32_t)s_st.avg_exec_us) >> 4) : ex;
+    s_st.loops++;
+    if (ex > CTASK::PERIOD_US) {
+      // chạy quá chu kỳ: bám lại mốc hiện tại thay vì chạy dồn các chu kỳ đã lỡ
+      s_st.overruns++;
+      wake = xTaskGetTickCount();
+    }
+    vTaskDelayUntil(&wake, period);
+  }
+}
+
+void CTASK::begin(StepFn step, ExecFn exec){
+  s_step = step; s_exec = exec;
+  if (s_task) return;
+  xTaskCreate(run, "ctrl", STACK_BYTES, nullptr, PRIORITY, &s_task);
+}
+
+CTASK::Stats CTASK::stats(){
+  Stats s = s_st;
+  s.stack_free = s_task ? (uint32_t)uxTaskGetStackHighWaterMark(s_task) : 0;
+  return s;
+}
+
+void CTASK::resetStats(){ s_reset = true; }
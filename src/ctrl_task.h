@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+
+// Task điều khiển riêng, ưu tiên cao, nhịp cố định 1 kHz (vTaskDelayUntil).
+// Đường QS/backfire/cắt chạy ở đây; web/DNS/LED ở loop() (loopTask, ưu tiên 1).
+// Web gửi lệnh qua hàng đợi SPSC không khóa; lệnh được thực thi đầu mỗi chu kỳ,
+// nên mọi trạng thái điều khiển chỉ bị sửa trong task này.
+// Task này không chạm flash/NVS và không biên dịch cấu hình: ghi NVS (GEAR), setBandCut (ATUNE)
+// chỉ đặt cờ/ô atomic rồi CFG::kick() cho task "cfgsave" (ưu tiên 1) làm, nên jitter bị chặn bởi
+// thời gian chạy của chính các bước điều khiển.
+namespace CTASK {
+  static constexpr uint32_t PERIOD_US = 1000;
+  static constexpr UBaseType_t PRIORITY = 12;    // > async_tcp (10), < tcpip/wifi (18/23)
+
+  enum class Cmd : uint8_t {
+    TEST_CUT = 0,    // u8 = 1 IGN / 0 INJ, u16 = ms
+    GEAR_RESET,
+    LOCK,
+    UNLOCK,          // mật khẩu đã được web kiểm tra
+    PWM_TEST         // u8 = bật, f0 = rpm, f1 = ppr
+  };
+  struct Msg { Cmd cmd; uint8_t u8; uint16_t u16; float f0, f1; };
+
+  using StepFn = void (*)();             // một chu kỳ điều khiển
+  using ExecFn = void (*)(const Msg &m); // thực thi lệnh (trong task điều khiển)
+
+  void begin(StepFn step, ExecFn exec);
+  // Một producer (task web async_tcp). false = hàng đầy, lệnh bị bỏ.
+  bool post(const Msg &m);
+  inline bool post(Cmd c){ return post(Msg{c, 0, 0, 0, 0}); }
+
+  struct Stats {
+    uint32_t loops;
+    uint32_t max_jitter_us;   // trễ lớn nhất so với mốc 1 kHz
+    uint32_t late;            // số chu kỳ trễ > 100 µs
+    uint32_t overruns;        // chu kỳ chạy lâu hơn PERIOD_US
+    uint32_t max_exec_us;
+    uint32_t avg_exec_us;     // EMA 1/16
+    uint32_t cmds, drops;     // lệnh đã chạy / bị bỏ vì hàng đầy
+    uint32_t stack_free;      // byte stack còn trống thấp nhất
+  };
+  Stats stats();
+  void resetStats();
+}
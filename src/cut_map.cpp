@@ -0,0 +1,93 @@
+#include "cut_map.h"
+
+
+static bool axisOk(const uint16_t *a, uint8_t n){
+  for (uint8_t i=1;i<n;i++) if (a[i] <= a[i-1]) return false;
+  return true;
+}
+
+uint8_t CMAP::validate(const QSConfig &c){
+  uint8_t st = MAP_OK;
+  const uint8_t n = constrain(c.map_count, (uint8_t)1, (uint8_t)7);
+  for (uint8_t i=0;i<n;i++){
+    const AutoBand &b = c.map[i];
+    if (b.rpm_lo >= b.rpm_hi) st |= ERR_ORDER;
+    if (i == 0) continue;
+    const AutoBand &p = c.map[i-1];
+    if (b.rpm_lo < p.rpm_hi) st |= ERR_OVERLAP;
+    else if (b.rpm_lo > p.rpm_hi) st |= WARN_GAP;
+  }
+  const CutMap2D &m = c.map2d;
+  if (m.nx < 2 || m.nx > MAP2D_X || m.ny < 1 || m.ny > MAP2D_Y ||
+      !axisOk(m.x_rpm, m.nx) || !axisOk(m.y_val, m.ny)) st |= ERR_AXIS2D;
+  return st;
+}
+
+static void compile2D(const CutMap2D &m, CMAP::Map2D &d){
+  d.nx = m.nx; d.ny = m.ny;
+  for (uint8_t i=0;i<d.nx;i++){
+    d.x[i]  = m.x_rpm[i];
+    d.rx[i] = (i+1 < d.nx) ? ((1UL << 24) / (uint32_t)(m.x_rpm[i+1] - m.x_rpm[i])) : 0;
+  }
+  for (uint8_t j=0;j<d.ny;j++){
+    d.y[j]  = m.y_val[j];
+    d.ry[j] = (j+1 < d.ny) ? ((1UL << 24) / (uint32_t)(m.y_val[j+1] - m.y_val[j])) : 0;
+    // kẹp ô về CUT_MS_MIN..MAX: lookup2D chỉ vừa int32 khi ô <= 32767 (cấu hình cũ trong NVS chưa kẹp)
+    for (uint8_t i=0;i<d.nx;i++) d.z[j][i] = constrain(m.cut_ms[j][i], CUT_MS_MIN, CUT_MS_MAX);
+  }
+}
+
+void CMAP::compile(const QSConfig &c, Compiled &out){
+  out.status = validate(c);
+  out.m2d_on = c.map2d.enabled && !(out.status & ERR_AXIS2D);
+  if (out.m2d_on) compile2D(c.map2d, out.m2d);
+  const uint8_t n = constrain(c.map_count, (uint8_t)1, (uint8_t)7);
+
+  // Điểm nội suy: tâm mỗi dải -> cut_ms của dải
+  uint16_t x[7], y[7];
+  for (uint8_t i=0;i<n;i++){
+    x[i] = (uint16_t)(((uint32_t)c.map[i].rpm_lo + c.map[i].rpm_hi) / 2);
+    y[i] = c.map[i].cut_ms;
+  }
+
+  uint8_t seg = 0;
+  for (uint16_t k=0;k<BUCKETS;k++){
+    const uint32_t rpm = ((uint32_t)k << BUCKET_SHIFT) + (1u << (BUCKET_SHIFT-1)); // tâm bucket
+    while (seg + 1 < n && rpm >= x[seg+1]) seg++;
+    int32_t v;
+    if (rpm <= x[0] || n == 1)      v = y[0];
+    else if (seg + 1 >= n)          v = y[n-1];
+    else {
+      const int32_t dx = (int32_t)x[seg+1] - x[seg];
+      v = (dx <= 0) ? y[seg]
+                    : y[seg] + ((int32_t)(y[seg+1] - y[seg]) * (int32_t)(rpm - x[seg]) + dx/2) / dx;
+    }
+    out.table[k] = (uint16_t)(v < 0 ? 0 : v);
+  }
+}
+
+// Tìm đoạn chứa v trên trục a[0..n), trả chỉ số i và phân số Q16 trong đoạn (r: nghịch đảo bước Q24)
+static inline uint8_t seg(const uint16_t *a, const uint32_t *r, uint8_t n, uint16_t v, uint32_t &f){
+  if (n < 2 || v <= a[0]) { f = 0; return 0; }
+  if (v >= a[n-1])        { f = 0; return n-1; }
+  uint8_t i = 0;
+  while (v >= a[i+1]) i++;
+  f = ((uint32_t)(v - a[i]) * r[i]) >> 8;   // (v - a[i]) < bước -> tích < 2^24
+  if (f > 65536) f = 65536;
+  return i;
+}
+
+uint16_t CMAP::lookup2D(const Compiled &m, uint16_t rpm, uint16_t y){
+  const Map2D &d = m.m2d;
+  uint32_t fx, fy;
+  const uint8_t i  = seg(d.x, d.rx, d.nx, rpm, fx);
+  const uint8_t j  = seg(d.y, d.ry, d.ny, y,   fy);
+  const uint8_t i1 = (i+1 < d.nx) ? i+1 : i;
+  const uint8_t j1 = (j+1 < d.ny) ? j+1 : j;
+  // Nội suy theo X trên hai hàng, rồi theo Y (Q16; + 2^15 trước khi dịch = làm tròn gần nhất, cả khi âm)
+  // (phân số <= 2^16 -> tích + 2^15 vừa int32 khi cut_ms <= 32767)
+  const int32_t a = d.z[j][i]  + (((d.z[j][i1]  - d.z[j][i])  * (int32_t)fx + 0x8000) >> 16);
+  const int32_t b = d.z[j1][i] + (((d.z[j1][i1] - d.z[j1][i]) * (int32_t)fx + 0x8000) >> 16);
+  const int32_t v = a + (((b - a) * (int32_t)fy + 0x8000) >> 16);
+  return (uint16_t)(v < 0 ? 0 : v);
+}
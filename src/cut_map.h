@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// Bản đồ thời gian cắt AUTO được "biên dịch" thành bảng theo bucket RPM.
+// Nội suy tuyến tính giữa tâm các dải; đường nóng chỉ còn một lần đọc bảng.
+// Map 2 chiều (RPM × Y) được biên dịch kèm nghịch đảo bước trục (Q24) để
+// nội suy song tuyến chỉ bằng nhân/dịch.
+namespace CMAP {
+  static constexpr uint8_t  BUCKET_SHIFT = 6;                       // 64 rpm / bucket
+  static constexpr uint16_t RPM_MAX      = 20000;                   // RPM::get() đã kẹp tại đây
+  static constexpr uint16_t BUCKETS      = (RPM_MAX >> BUCKET_SHIFT) + 1;
+
+  // Kết quả kiểm tra map (bitmask)
+  enum : uint8_t {
+    MAP_OK      = 0,
+    ERR_ORDER   = 0x01,   // dải có lo >= hi
+    ERR_OVERLAP = 0x02,   // dải chồng lên / không theo thứ tự tăng dần
+    WARN_GAP    = 0x04,   // có khoảng trống giữa hai dải (được nội suy)
+    ERR_AXIS2D  = 0x08    // trục map 2D không tăng dần / kích thước sai
+  };
+  static constexpr uint8_t ERR_MASK = ERR_ORDER | ERR_OVERLAP | ERR_AXIS2D;
+
+  uint8_t validate(const QSConfig &c);
+
+  // Map 2D đã biên dịch
+  struct Map2D {
+    uint8_t  nx, ny;
+    uint16_t x[MAP2D_X], y[MAP2D_Y];
+    uint32_t rx[MAP2D_X], ry[MAP2D_Y];   // 2^24 / (x[i+1]-x[i]), Q24 (Q16 mất ~1.6% ở bước 1500 rpm)
+    int32_t  z[MAP2D_Y][MAP2D_X];
+  };
+  // Bảng đã biên dịch của một phiên bản cấu hình (nằm trong CtrlParams, bất biến sau khi công bố)
+  struct Compiled {
+    uint8_t  status;                 // kết quả validate
+    bool     m2d_on;                 // map 2D bật và trục hợp lệ
+    uint16_t table[BUCKETS];         // cut_ms theo bucket
+    Map2D    m2d;
+  };
+  void compile(const QSConfig &c, Compiled &out);   // gọi khi cấu hình đổi
+
+  inline uint16_t lookup(const Compiled &m, uint16_t rpm){
+    return m.table[min<uint16_t>(rpm, RPM_MAX) >> BUCKET_SHIFT];
+  }
+  uint16_t lookup2D(const Compiled &m, uint16_t rpm, uint16_t y);
+}
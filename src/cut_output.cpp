@@ -1,46 +1,379 @@
 #include "cut_output.h"
 #include "pins.h"
+#include <esp_timer.h>
+#include <hal/gpio_ll.h>
 
 // ---- state ----
 static uint8_t pIgn, pInj;
-static bool s_ign=false, s_inj=false;
-static bool s_pulsing=false;
-static uint32_t s_pulse_end=0;
-static CutLine s_pulse_line=CutLine::IGN;
+
+// ---- segment engine: mỗi line một hàng đợi + một esp_timer ----
+static constexpr int64_t EDGE_EPS_US = 20;    // cạnh hẹn trong 20 µs tới: xử lý luôn, không hẹn timer
+static constexpr int64_t LATE_US     = 200;   // mở trễ hơn mức này -> đếm late
+static constexpr int64_t SYNC_US     = 100000; // có cạnh RPM trong 100 ms gần nhất -> cắt theo tia lửa được
+static constexpr int64_t WAIT_MAX_US = 50000;  // chờ cạnh N tối đa (cũng <= 2 chu kỳ)
+static constexpr int64_t GUARD_MIN_US= 100;    // đóng trước cạnh N+k ít nhất chừng này
+
+// sparks = 0: đoạn theo thời gian [at, end); > 0: đoạn theo tia lửa, end - at = fallback
+// prog: đoạn lũy tiến, dùng mẫu tỉ lệ của line
+struct Seg { int64_t at, end; uint8_t sparks; bool prog; };
+struct Line {
+  esp_timer_handle_t tmr;
+  CutLine  id;
+  Seg      q[CUT::QUEUE_DEPTH];
+  uint8_t  head, count;
+  bool     on;
+  int64_t  t_on, end;
+  uint32_t req;
+  uint8_t  wait_k;     // > 0: đoạn spark đã tới hạn, chờ cạnh N để mở
+  bool     wait_prog;  // đoạn đang chờ là đoạn lũy tiến
+  uint32_t wait_fb;    // fallback của đoạn đang chờ
+  int64_t  wait_until;
+  uint8_t  left;       // số cạnh còn lại của đoạn spark đang chạy (0 = đoạn thời gian)
+  // lũy tiến: line giữ bởi chủ suốt cửa sổ, gate quyết định có xuất mức cắt cho tia kế tiếp
+  bool     prog, gate, virt;
+  uint8_t  step, steps, acc;
+  int64_t  t_edge;     // mốc cạnh (thật hoặc dự đoán) của bước hiện tại
+  uint8_t  pat[CUT::PATTERN_MAX], pat_n;
+  uint8_t  qowner;     // chủ của hàng đợi (hợp lệ khi on || count)
+  uint8_t  holds;      // bit giữ tĩnh theo chủ
+  bool     level;      // mức đang xuất ra chân
+  CUT::QueueStats st;
+};
+static Line s_line[2];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static CUT::PulseStats s_stats{};
+static CUT::ArbStats   s_arb[CUT::OWNERS];
+static uint32_t        s_lastAct[CUT::OWNERS];   // độ rộng thực tế đoạn gần nhất theo chủ (s_stats gộp mọi chủ/line)
+static volatile int64_t s_lastEdge = 0;      // cạnh RPM gần nhất (esp_timer, µs)
+static volatile int64_t s_period   = 0;      // chu kỳ cạnh gần nhất
+
+static IRAM_ATTR Line& lineOf(CutLine l){ return s_line[l==CutLine::IGN ? 0 : 1]; }
+static IRAM_ATTR inline bool qbusy(const Line &L){ return L.on || L.count || L.wait_k; }
+static IRAM_ATTR inline bool syncBusy(const Line &L){ return L.wait_k || L.left || L.prog; }   // cần cạnh RPM
+static IRAM_ATTR inline uint8_t ownerMask(const Line &L){ return L.holds | (L.on && L.gate ? (uint8_t)(1u << L.qowner) : 0); }
+// có chủ ưu tiên cao hơn o đang giữ line (tĩnh, hoặc hàng đợi đang chờ/chạy)?
+static IRAM_ATTR inline bool higherPresent(const Line &L, uint8_t o){
+  return ((L.holds | (qbusy(L) ? (uint8_t)(1u << L.qowner) : 0)) >> (o + 1)) != 0;
+}
+
+// Xuất mức = OR mọi chủ; chỉ ghi chân khi đổi nên chuyển chủ không tạo xung nhả
+static void IRAM_ATTR apply(Line &L){
+  const bool lv = ownerMask(L) != 0;
+  if (lv == L.level) return;
+  L.level = lv;
+  gpio_ll_set_level(&GPIO, (gpio_num_t)(L.id==CutLine::IGN ? pIgn : pInj), lv ? 1 : 0);
+}
+
+static void IRAM_ATTR arm(Line &L, int64_t dt){
+  esp_timer_stop(L.tmr);
+  esp_timer_start_once(L.tmr, (uint64_t)dt);
+}
+
+static IRAM_ATTR inline int64_t guardUs(int64_t p){ return max<int64_t>(p >> 3, GUARD_MIN_US); }
+
+// Mở đoạn tại now, dài dur (µs); left > 0 = đoạn spark, mốc đóng còn được cạnh hiệu chỉnh
+static void IRAM_ATTR openSeg(Line &L, int64_t now, int64_t dur, uint8_t left){
+  L.req = (uint32_t)dur;
+  L.t_on = now; L.end = now + dur; L.on = true; L.left = left;
+  L.prog = false; L.gate = true;
+}
+
+// Tỉ lệ bỏ (%) tại bước i của cửa sổ, nội suy tuyến tính giữa các điểm mẫu
+static IRAM_ATTR uint8_t progPct(const Line &L, uint8_t i){
+  if (L.pat_n < 2 || L.steps < 2) return L.pat[0];
+  const uint32_t pos = (uint32_t)i * (L.pat_n - 1) * 256u / (L.steps - 1);
+  const uint8_t  k = (uint8_t)(pos >> 8), f = (uint8_t)pos;
+  if (k + 1 >= L.pat_n) return L.pat[L.pat_n - 1];
+  return (uint8_t)(L.pat[k] + (((int32_t)L.pat[k+1] - L.pat[k]) * f >> 8));
+}
+
+// Một bước lũy tiến tại mốc cạnh t: quyết định tia kế tiếp, hẹn cạnh dự đoán (chu kỳ + 1/4)
+static void IRAM_ATTR progStep(Line &L, int64_t t, int64_t per){
+  L.t_edge = t;
+  if (L.step >= L.steps) { L.end = t; return; }   // đã xét đủ tia: nhả
+  L.acc += progPct(L, L.step);
+  L.gate = L.acc >= 100;
+  if (L.gate) { L.acc -= 100; L.st.prog_cut++; }
+  L.st.prog_steps++;
+  L.end = t + per + (per >> 2);
+}
+
+static void IRAM_ATTR startProg(Line &L, int64_t now, uint8_t k, int64_t per){
+  openSeg(L, now, (int64_t)(k + 1) * per, 0);
+  L.prog = true; L.virt = false;
+  L.step = 0; L.steps = k; L.acc = 50;            // bắt đầu nửa chừng: 50% ra đều, không dồn về một phía
+  progStep(L, now, per);
+}
+
+// Kết thúc đoạn đang chạy và ghi lại độ rộng thực tế
+static void IRAM_ATTR release(Line &L, int64_t now){
+  L.on = false; L.left = 0; L.prog = false;
+  const uint32_t act = (uint32_t)(now - L.t_on);
+  const int32_t  err = (int32_t)act - (int32_t)L.req;
+  s_stats.last_req_us = L.req;
+  s_stats.last_act_us = act;
+  s_lastAct[L.qowner] = act;
+  if (s_stats.count == 0 || err < s_stats.min_err_us) s_stats.min_err_us = err;
+  if (s_stats.count == 0 || err > s_stats.max_err_us) s_stats.max_err_us = err;
+  s_stats.count++;
+  L.st.segs++;
+}
+
+// Bỏ toàn bộ hàng đợi (đoạn đang chạy dừng ngay); không ghi chân, apply() làm sau
+static void IRAM_ATTR drop(Line &L){
+  esp_timer_stop(L.tmr);
+  if (L.on) s_lastAct[L.qowner] = (uint32_t)(esp_timer_get_time() - L.t_on);   // đoạn bị cắt ngang: độ rộng thật ngắn hơn
+  L.head = L.count = 0; L.st.depth = 0;
+  L.on = false; L.left = 0; L.wait_k = 0; L.prog = false;
+}
+
+// Chạy mọi cạnh đã tới hạn, hẹn timer cho cạnh kế tiếp, rồi xuất mức. Gọi trong s_mux.
+static void IRAM_ATTR service(Line &L){
+  for (;;) {
+    const int64_t now = esp_timer_get_time();
+    if (L.on) {
+      if (L.end - now > EDGE_EPS_US) { arm(L, L.end - now); break; }
+      if (L.prog && L.step < L.steps) {
+        // cạnh dự đoán: tia vừa rồi không thấy cạnh (bị bỏ hoặc mất tín hiệu)
+        const int64_t per = s_period;
+        L.st.prog_virt++; L.virt = true;
+        L.step++;
+        progStep(L, L.t_edge + per, per);
+        continue;
+      }
+      release(L, now);
+      continue;
+    }
+    if (L.wait_k) {
+      if (L.wait_until - now > EDGE_EPS_US) { arm(L, L.wait_until - now); break; }
+      // không thấy cạnh N: mở theo thời gian dự phòng (lũy tiến -> cắt liền)
+      L.st.spark_fallback++;
+      openSeg(L, now, L.wait_fb, 0); L.wait_k = 0;
+      continue;
+    }
+    if (!L.count) { L.st.depth = 0; break; }
+    const Seg s = L.q[L.head];
+    if (s.at - now > EDGE_EPS_US) { arm(L, s.at - now); break; }
+    L.head = (L.head + 1) % CUT::QUEUE_DEPTH; L.count--;
+    L.st.depth = L.count;
+    const int64_t late = now - s.at;
+    if (late > LATE_US) { L.st.late++; if ((uint32_t)late > L.st.max_late_us) L.st.max_late_us = (uint32_t)late; }
+    if (s.sparks) {
+      const int64_t p = s_period;
+      if (p > 0 && now - s_lastEdge < SYNC_US) {
+        // chờ cạnh kế tiếp (N); onEdge() mở
+        L.wait_k = s.sparks; L.wait_prog = s.prog; L.wait_fb = (uint32_t)(s.end - s.at);
+        L.wait_until = now + min<int64_t>(2 * p + LATE_US, WAIT_MAX_US);
+        continue;
+      }
+      L.st.spark_fallback++;
+    }
+    // giữ nguyên độ rộng; các đoạn sau vẫn theo mốc tuyệt đối nên chuỗi không trôi
+    openSeg(L, now, s.end - s.at, 0);
+  }
+  apply(L);
+}
+
+static void onLineTimer(void *arg){
+  portENTER_CRITICAL_SAFE(&s_mux);
+  service(*(Line*)arg);
+  portEXIT_CRITICAL_SAFE(&s_mux);
+}
 
 // ---- impl ----
 void CUT::begin(uint8_t pinIgn, uint8_t pinInj){
   pIgn=pinIgn; pInj=pinInj;
   pinMode(pIgn, OUTPUT); pinMode(pInj, OUTPUT);
   digitalWrite(pIgn, LOW); digitalWrite(pInj, LOW);
-  s_ign = s_inj = s_pulsing = false;
+
+  for (uint8_t i=0;i<2;i++){
+    Line &L = s_line[i];
+    L.id = i==0 ? CutLine::IGN : CutLine::INJ;
+    L.head = L.count = 0; L.on = false;
+    L.qowner = 0; L.holds = 0; L.level = false;
+    if (!L.tmr){
+      esp_timer_create_args_t a{};
+      a.callback = &onLineTimer;
+      a.arg      = &L;
+      a.name     = i==0 ? "cut_ign" : "cut_inj";
+      esp_timer_create(&a, &L.tmr);
+    }
+  }
 }
 
-void CUT::set(CutLine line, bool cutting){
-  const uint8_t p = (line==CutLine::IGN? pIgn : pInj);
-  digitalWrite(p, cutting? HIGH:LOW);
-  if (line==CutLine::IGN) s_ign = cutting; else s_inj = cutting;
+void IRAM_ATTR CUT::hold(CutOwner o, CutLine line, bool on){
+  Line &L = lineOf(line);
+  const uint8_t ob = (uint8_t)o, bit = (uint8_t)(1u << ob);
+  portENTER_CRITICAL_SAFE(&s_mux);
+  if (on && !(L.holds & bit)) {
+    // giữ tĩnh chiếm hàng đợi của chủ thấp hơn (để không còn đoạn sót khi nhả)
+    if (qbusy(L) && L.qowner < ob) { s_arb[L.qowner].preempted++; drop(L); }
+    L.holds |= bit;
+    s_arb[ob].granted++;
+  } else if (!on) {
+    L.holds &= (uint8_t)~bit;
+  }
+  apply(L);
+  portEXIT_CRITICAL_SAFE(&s_mux);
 }
 
-bool CUT::isActive(){ return s_ign || s_inj; }
+bool CUT::isActive(){ return s_line[0].level || s_line[1].level; }
+
+uint8_t CUT::holders(CutLine line){ return ownerMask(lineOf(line)); }
 
-// Pulse không chặn (non-blocking), gọi CUT::tick() trong loop
-void CUT::pulse(CutLine line, uint16_t ms){
-  CUT::set(line, true);
-  s_pulsing = true; s_pulse_line = line;
-  s_pulse_end = millis() + (uint32_t)ms;
+// Xếp một đoạn cho chủ ob; replace = bỏ trước các đoạn cũ của chính chủ này.
+// Một lần giữ s_mux nên thay xung không làm line nhả giữa chừng.
+static bool IRAM_ATTR enqueue(Line &L, uint8_t ob, uint32_t delay_us, uint32_t dur_us, bool replace,
+                             uint8_t sparks = 0, const uint8_t *pct = nullptr, uint8_t npct = 0){
+  if (!L.tmr || !dur_us) return false;
+  bool ok = true;
+  portENTER_CRITICAL_SAFE(&s_mux);
+  if (higherPresent(L, ob)) {
+    s_arb[ob].denied++;
+    s_lastAct[ob] = 0;                       // không xuất được: log của chủ này ghi 0, không lấy số cũ
+    portEXIT_CRITICAL_SAFE(&s_mux);
+    return false;
+  }
+  if (qbusy(L)) {
+    if (L.qowner != ob) { s_arb[L.qowner].preempted++; drop(L); }   // chủ thấp hơn
+    else if (replace)   { if (L.on) release(L, esp_timer_get_time()); drop(L); }
+  }
+  L.qowner = ob;
+  const int64_t at = esp_timer_get_time() + delay_us, end = at + dur_us;
+  // gộp với đoạn cuối (đang chờ hoặc đang chạy) nếu chồng lên; đoạn spark không gộp
+  Seg *tail = L.count ? &L.q[(L.head + L.count - 1) % CUT::QUEUE_DEPTH] : nullptr;
+  const bool mergeable = !sparks && (tail ? !tail->sparks : !syncBusy(L));
+  if (mergeable && tail && at <= tail->end) { if (end > tail->end) tail->end = end; }
+  else if (mergeable && !tail && L.on && at <= L.end) {
+    if (end > L.end) { L.req += (uint32_t)(end - L.end); L.end = end; }
+  }
+  else if (L.count >= CUT::QUEUE_DEPTH) { L.st.overruns++; ok = false; }
+  else {
+    const bool prog = sparks && pct && npct;
+    if (prog) { L.pat_n = min<uint8_t>(npct, CUT::PATTERN_MAX); memcpy(L.pat, pct, L.pat_n); }
+    L.q[(L.head + L.count) % CUT::QUEUE_DEPTH] = Seg{at, end, sparks, prog};
+    L.count++;
+    L.st.depth = L.count;
+    if (L.count > L.st.max_depth) L.st.max_depth = L.count;
+  }
+  if (ok) s_arb[ob].granted++;
+  service(L);
+  portEXIT_CRITICAL_SAFE(&s_mux);
+  return ok;
+}
+
+bool IRAM_ATTR CUT::queue(CutOwner o, CutLine line, uint32_t delay_us, uint32_t dur_us){
+  return enqueue(lineOf(line), (uint8_t)o, delay_us, dur_us, false);
+}
+
+bool IRAM_ATTR CUT::queueSparks(CutOwner o, CutLine line, uint32_t delay_us, uint8_t sparks, uint32_t fallback_us){
+  if (!sparks) return false;
+  return enqueue(lineOf(line), (uint8_t)o, delay_us, fallback_us, false, sparks);
+}
+
+void IRAM_ATTR CUT::pulseSparks(CutOwner o, CutLine line, uint8_t sparks, uint32_t fallback_us){
+  if (sparks) enqueue(lineOf(line), (uint8_t)o, 0, fallback_us, true, sparks);
+}
+
+void IRAM_ATTR CUT::pulsePattern(CutOwner o, CutLine line, uint8_t sparks, uint32_t fallback_us,
+                                 const uint8_t *pct, uint8_t n){
+  if (sparks) enqueue(lineOf(line), (uint8_t)o, 0, fallback_us, true, sparks, pct, n);
+}
+
+bool CUT::burstSparks(CutOwner o, CutLine line, uint8_t count, uint8_t sparks, uint32_t on_us, uint32_t off_us){
+  bool ok = true;
+  for (uint8_t i=0;i<count;i++) ok &= CUT::queueSparks(o, line, i * (on_us + off_us), sparks, on_us);
+  return ok;
+}
+
+// ISR cạnh RPM: ghi chu kỳ; mở đoạn spark đang chờ (cạnh N), hiệu chỉnh mốc đóng (trước cạnh N+k+1),
+// hoặc bước tiếp đoạn lũy tiến
+void IRAM_ATTR CUT::onEdge(){
+  const int64_t now = esp_timer_get_time();
+  const int64_t p = now - s_lastEdge, p0 = s_period;
+  s_lastEdge = now;
+  const bool sync = syncBusy(s_line[0]) || syncBusy(s_line[1]);
+  // đang cắt theo tia lửa: chu kỳ dài đột ngột là cạnh bị bỏ, không phải RPM rơi
+  const bool gap = p0 > 0 && p > p0 + (p0 >> 1) + (p0 >> 3);
+  if (p > 0 && p < SYNC_US && !(sync && gap)) s_period = p;
+  if (!sync) return;
+  const int64_t per = s_period;
+  if (per <= 0) return;
+  portENTER_CRITICAL_SAFE(&s_mux);
+  for (Line &L : s_line){
+    if (L.wait_k) {
+      const uint8_t k = min<uint8_t>(L.wait_k, 254); L.wait_k = 0;
+      if (L.wait_prog) startProg(L, now, k, per);
+      else openSeg(L, now, (k + 1) * per - guardUs(per), k + 1);   // bỏ tia N+1..N+k
+      service(L);
+    } else if (L.on && L.prog) {
+      // cạnh thật tới ngay sau cạnh dự đoán: cùng một tia, chỉ neo lại mốc
+      if (L.virt && now - L.t_edge < (per >> 1)) { L.t_edge = now; L.end = now + per + (per >> 2); }
+      else { L.step++; progStep(L, now, per); }
+      L.virt = false;
+      service(L);
+    } else if (L.on && L.left) {
+      if (--L.left == 0) L.end = now;                       // dự đoán trễ: cạnh N+k+1 đã tới, đóng ngay
+      else L.end = now + L.left * per - guardUs(per);
+      L.req = (uint32_t)(L.end - L.t_on);
+      service(L);
+    }
+  }
+  portEXIT_CRITICAL_SAFE(&s_mux);
+}
+
+bool CUT::burst(CutOwner o, CutLine line, uint8_t count, uint32_t on_us, uint32_t off_us){
+  bool ok = true;
+  for (uint8_t i=0;i<count;i++) ok &= CUT::queue(o, line, i * (on_us + off_us), on_us);
+  return ok;
 }
 
-void CUT::tick(){
-  if (s_pulsing && (millis() >= s_pulse_end)){
-    CUT::set(s_pulse_line, false);
-    s_pulsing = false;
+void IRAM_ATTR CUT::flush(CutOwner o, CutLine line){
+  Line &L = lineOf(line);
+  if (!L.tmr) return;
+  portENTER_CRITICAL_SAFE(&s_mux);
+  if (qbusy(L) && L.qowner == (uint8_t)o) {
+    if (L.on) release(L, esp_timer_get_time());
+    drop(L);
+    apply(L);
   }
+  portEXIT_CRITICAL_SAFE(&s_mux);
+}
+
+bool CUT::busy(CutLine line){ return qbusy(lineOf(line)); }
+
+bool CUT::busy(CutOwner o){
+  for (const Line &L : s_line) if (qbusy(L) && L.qowner == (uint8_t)o) return true;
+  return false;
+}
+
+void IRAM_ATTR CUT::pulseUs(CutOwner o, CutLine line, uint32_t us){
+  enqueue(lineOf(line), (uint8_t)o, 0, us, true);
+}
+
+bool CUT::pulseBusy(){ return CUT::busy(CutLine::IGN) || CUT::busy(CutLine::INJ); }
+
+CUT::QueueStats CUT::queueStats(CutLine line){ return lineOf(line).st; }
+
+CUT::ArbStats CUT::arbStats(CutOwner o){ return s_arb[(uint8_t)o]; }
+
+CUT::PulseStats CUT::pulseStats(){ return s_stats; }
+uint32_t CUT::lastActUs(CutOwner o){ return s_lastAct[(uint8_t)o]; }
+void CUT::resetPulseStats(){
+  portENTER_CRITICAL_SAFE(&s_mux);
+  s_stats = PulseStats{};
+  for (Line &L : s_line){ const uint8_t d = L.st.depth; L.st = QueueStats{}; L.st.depth = d; }
+  for (ArbStats &a : s_arb) a = ArbStats{};
+  for (uint32_t &a : s_lastAct) a = 0;
+  portEXIT_CRITICAL_SAFE(&s_mux);
+}
+
+// Pulse không chặn (non-blocking), nhả bằng esp_timer
+void CUT::pulse(CutOwner o, CutLine line, uint16_t ms){
+  CUT::pulseUs(o, line, (uint32_t)ms * 1000UL);
 }
 
-// Test blocking (chỉ dùng cho /api/testcut)
+// Test xung (dùng cho /api/testcut): đi qua hàng đợi, không chặn handler web
 void CUT_testPulse(bool useIgn, uint16_t ms){
-  CUT::set(useIgn? CutLine::IGN : CutLine::INJ, true);
-  delay(ms);
-  CUT::set(useIgn? CutLine::IGN : CutLine::INJ, false);
+  CUT::queue(CutOwner::TEST, useIgn? CutLine::IGN : CutLine::INJ, 0, (uint32_t)ms * 1000UL);
 }
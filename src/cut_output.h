@@ -2,12 +2,86 @@
 #include <Arduino.h>
 
 enum class CutLine { IGN=0, INJ=1 };
+// Chủ của lệnh cắt, ưu tiên tăng dần: LOCK > QS > BF > TEST
+enum class CutOwner : uint8_t { TEST=0, BF=1, QS=2, LOCK=3 };
 
 namespace CUT {
+  static constexpr uint8_t OWNERS = 4;
+
   void begin(uint8_t pinIgn, uint8_t pinInj);
-  void set(CutLine line, bool cutting); // true = open (cut), false = closed (run)
+  // Giữ/nhả tĩnh theo chủ (vd. LOCK khi khóa). Mỗi chủ một bit: line mở khi còn
+  // bất kỳ bit nào, nên nhả của chủ này không bao giờ thả line chủ khác đang giữ.
+  void hold(CutOwner o, CutLine line, bool on);
   bool isActive();                         // đang có line nào bị cắt?
-void pulse(CutLine line, uint16_t ms);   // cắt không chặn trong ms
-void tick();                             // gọi mỗi vòng loop để nhả đúng hẹn
+  uint8_t holders(CutLine line);           // bitmask chủ đang giữ line (kể cả đoạn đang chạy)
+  void pulse(CutOwner o, CutLine line, uint16_t ms);   // cắt không chặn trong ms
+
+  // Cắt one-shot: bỏ các đoạn đang chờ của chủ trên line, mở ngay, nhả sau us.
+  // An toàn khi gọi từ ISR (IRAM).
+  void pulseUs(CutOwner o, CutLine line, uint32_t us);
+  bool pulseBusy();                        // còn đoạn cắt nào đang chạy/chờ?
+  bool busy(CutOwner o);                   // chủ o còn đoạn đang chạy/chờ?
+
+  // ===== Hàng đợi đoạn cắt theo line =====
+  // Mỗi line một esp_timer (systimer, µs); mốc thời gian tuyệt đối int64 nên không tràn.
+  // Đoạn chồng lên đoạn trước được gộp; hàng đầy -> bỏ đoạn mới và đếm overrun.
+  // Hàng đợi của một line thuộc về một chủ: chủ cao hơn chiếm (bỏ đoạn của chủ thấp),
+  // chủ thấp hơn bị từ chối khi chủ cao đang giữ/chạy trên line. Mọi phép xét là O(1).
+  static constexpr uint8_t QUEUE_DEPTH = 8;
+  bool queue(CutOwner o, CutLine line, uint32_t delay_us, uint32_t dur_us);          // IRAM
+  bool burst(CutOwner o, CutLine line, uint8_t count, uint32_t on_us, uint32_t off_us); // chuỗi xung
+  void flush(CutOwner o, CutLine line);    // bỏ mọi đoạn của chủ o trên line
+  bool busy(CutLine line);
+
+  // ===== Cắt theo số tia lửa (đồng bộ cạnh RPM) =====
+  // Đoạn spark tới hạn thì chờ cạnh kế tiếp N: mở ngay sau cạnh N, đóng ngay trước
+  // cạnh N+k+1 (bỏ k tia N+1..N+k); mỗi cạnh trong lúc cắt tính lại mốc đóng theo chu kỳ mới nhất.
+  // Không có cạnh (backend RMT giao theo lô, máy tắt) -> chạy theo fallback_us.
+  bool queueSparks(CutOwner o, CutLine line, uint32_t delay_us, uint8_t sparks, uint32_t fallback_us);
+  void pulseSparks(CutOwner o, CutLine line, uint8_t sparks, uint32_t fallback_us);   // IRAM
+  bool burstSparks(CutOwner o, CutLine line, uint8_t count, uint8_t sparks, uint32_t on_us, uint32_t off_us);
+  void onEdge();                           // IRAM: gọi từ ISR cạnh RPM (RPM::setEdgeHook)
+
+  // ===== Cắt lũy tiến: bỏ một phần tia lửa =====
+  // Cửa sổ sparks chu kỳ bắt đầu sau cạnh N; ở mỗi cạnh quyết định tia kế tiếp có bị bỏ
+  // không theo tỉ lệ pct[0..n) (%) nội suy dọc cửa sổ, cộng dồn kiểu Bresenham (50% = bỏ xen kẽ).
+  // Cạnh không tới (IGN cắt luôn xung bobin) được thay bằng cạnh dự đoán theo chu kỳ cuối.
+  // Không đồng bộ được -> cắt liền fallback_us.
+  static constexpr uint8_t PATTERN_MAX = 8;
+  void pulsePattern(CutOwner o, CutLine line, uint8_t sparks, uint32_t fallback_us,
+                    const uint8_t *pct, uint8_t n);   // IRAM
+
+  struct QueueStats {
+    uint8_t  depth;        // số đoạn đang chờ (không tính đoạn đang chạy)
+    uint8_t  max_depth;
+    uint32_t segs;         // số đoạn đã chạy xong
+    uint32_t overruns;     // đoạn bị bỏ vì hàng đầy
+    uint32_t late;         // đoạn mở trễ hơn LATE_US so với hẹn
+    uint32_t max_late_us;
+    uint32_t spark_fallback; // đoạn spark phải chạy theo thời gian (không có cạnh RPM)
+    uint32_t prog_steps;   // số tia lửa đã xét ở chế độ lũy tiến
+    uint32_t prog_cut;     // trong đó số tia bị bỏ
+    uint32_t prog_virt;    // số cạnh phải dự đoán (không thấy cạnh thật)
+  };
+  QueueStats queueStats(CutLine line);
+
+  // Tranh chấp theo chủ
+  struct ArbStats {
+    uint32_t granted;      // yêu cầu được nhận
+    uint32_t denied;       // bị từ chối vì chủ cao hơn đang giữ line
+    uint32_t preempted;    // đoạn của chủ này bị chủ cao hơn chiếm
+  };
+  ArbStats arbStats(CutOwner o);
 
+  // Thống kê độ rộng xung: yêu cầu vs thực tế (đo bằng esp_timer_get_time)
+  struct PulseStats {
+    uint32_t count;       // số xung đã nhả
+    uint32_t last_req_us; // độ rộng yêu cầu của xung gần nhất
+    uint32_t last_act_us; // độ rộng thực tế của xung gần nhất
+    int32_t  min_err_us;  // sai số nhỏ nhất (act - req)
+    int32_t  max_err_us;  // sai số lớn nhất (act - req)
+  };
+  PulseStats pulseStats();                 // gộp mọi line/chủ: xung gần nhất có thể là của chủ khác
+  uint32_t lastActUs(CutOwner o);          // độ rộng thực tế đoạn gần nhất của chủ o: bị cắt ngang -> phần đã chạy, bị từ chối -> 0
+  void resetPulseStats();                  // xóa cả thống kê hàng đợi và tranh chấp
 }
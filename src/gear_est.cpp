@@ -0,0 +1,128 @@
+#include "gear_est.h"
+#include "rpm_track.h"
+#include "config_store.h"
+#include <Preferences.h>
+
+static constexpr uint16_t RATIO_LO    = 2048;   // 0.50: rơi sâu hơn -> không phải sang số
+static constexpr uint16_t RATIO_HI    = 3973;   // 0.97: gần như không rơi -> bỏ (sang hụt)
+static constexpr uint16_t TOL         = 100;    // ~2.4% quanh tỉ lệ đã học
+static constexpr uint16_t MIN_SEP     = 24;     // giữ các cặp tăng dần để phân loại không lẫn
+static constexpr uint16_t SAVE_DELTA  = 16;     // chỉ ghi NVS khi lệch bản đã lưu >= ~0.4%
+static constexpr uint32_t WINDOW_MS   = 400;    // cửa sổ tìm đáy RPM sau khi mở cắt
+static constexpr uint32_t MIN_MS      = 20;     // đáy không thể tới sớm hơn cắt ngắn nhất
+static constexpr uint32_t LOST_MS     = 2000;   // mất RPM lâu -> máy tắt, không biết số
+
+// Tỉ lệ mặc định điển hình xe số 6 cấp (1->2 .. 5->6), Q12
+static const uint16_t DEF_RATIO[GEAR::PAIRS] = {2990, 3277, 3482, 3604, 3727};
+
+static Preferences gp;
+static uint16_t s_ratio[GEAR::PAIRS];
+static uint16_t s_saved[GEAR::PAIRS];       // bản đã hẹn ghi
+static volatile bool s_dirty = false;
+static uint8_t  s_n[GEAR::PAIRS];
+static uint8_t  s_gear = 0;
+static uint16_t s_last = 0;
+
+static bool     s_meas = false;
+static uint16_t s_pre = 0, s_min = 0;
+static uint32_t s_t0 = 0, s_tSeen = 0;
+
+// learn()/reset() chạy trong task điều khiển: chỉ đánh dấu, task "cfgsave" ghi NVS (persist)
+static void save(){
+  memcpy(s_saved, s_ratio, sizeof(s_ratio));
+  s_dirty = true;
+  CFG::kick();
+}
+
+// Task cfgsave. Mỗi phần tử 16/8 bit được ghi nguyên khối nên bản chép không rách từng cặp;
+// học thêm trong lúc chép thì lần sau ghi lại.
+static void persist(){
+  if (!s_dirty) return;
+  s_dirty = false;
+  uint16_t q[GEAR::PAIRS]; uint8_t n[GEAR::PAIRS];
+  memcpy(q, s_ratio, sizeof(q)); memcpy(n, s_n, sizeof(n));
+  gp.putBytes("rq", q, sizeof(q));
+  gp.putBytes("rn", n, sizeof(n));
+}
+
+static void learn(uint8_t k, uint16_t m){
+  // vài mẫu đầu hội tụ nhanh, sau đó EMA 1/8
+  const uint8_t sh = s_n[k] < 4 ? 1 : 3;
+  int32_t r = s_ratio[k] + (((int32_t)m - (int32_t)s_ratio[k]) >> sh);
+  const int32_t lo = k > 0 ? s_ratio[k-1] + MIN_SEP : RATIO_LO;
+  const int32_t hi = k+1 < GEAR::PAIRS ? s_ratio[k+1] - MIN_SEP : RATIO_HI;
+  if (lo <= hi) r = constrain(r, lo, hi);
+  s_ratio[k] = (uint16_t)r;
+  if (s_n[k] < 255) s_n[k]++;
+  if (abs((int32_t)s_ratio[k] - (int32_t)s_saved[k]) >= SAVE_DELTA) save();
+}
+
+// Kết thúc một lần đo: phân loại cặp số theo tỉ lệ, cập nhật số hiện tại, học nếu chắc chắn
+static void finish(uint16_t post){
+  s_meas = false;
+  const uint16_t m = (uint16_t)(((uint32_t)post << 12) / s_pre);
+  s_last = m;
+  if (m < RATIO_LO || m > RATIO_HI) return;
+
+  const uint8_t exp = (s_gear >= 1 && s_gear <= GEAR::PAIRS) ? s_gear : 0;
+  uint8_t best = 0; uint16_t dBest = 0xFFFF, d2 = 0xFFFF;
+  for (uint8_t k=0;k<GEAR::PAIRS;k++){
+    const uint16_t d = (uint16_t)abs((int32_t)m - (int32_t)s_ratio[k]);
+    if (d < dBest) { d2 = dBest; dBest = d; best = k + 1; }
+    else if (d < d2) d2 = d;
+  }
+
+  uint8_t pair = 0; bool sure = false;
+  if (exp && abs((int32_t)m - (int32_t)s_ratio[exp-1]) <= TOL) { pair = exp; sure = true; }   // khớp thứ tự số
+  else if (dBest <= TOL || 2u*dBest <= d2) {                                                   // bắt lại theo tỉ lệ
+    pair = best;
+    sure = (2u*dBest <= d2) && dBest <= 2*TOL;   // rõ ràng gần một cặp hơn hẳn cặp kế
+  }
+  if (!pair) { s_gear = exp ? exp + 1 : 0; return; }   // không khớp cặp nào: chỉ giả định lên 1 số
+
+  s_gear = pair + 1;
+  if (sure) learn(pair - 1, m);
+}
+
+void GEAR::begin(){
+  memcpy(s_ratio, DEF_RATIO, sizeof(s_ratio));
+  memset(s_n, 0, sizeof(s_n));
+  gp.begin("gear", false);
+  if (gp.getBytesLength("rq") == sizeof(s_ratio)) gp.getBytes("rq", s_ratio, sizeof(s_ratio));
+  if (gp.getBytesLength("rn") == sizeof(s_n))     gp.getBytes("rn", s_n, sizeof(s_n));
+  memcpy(s_saved, s_ratio, sizeof(s_ratio));
+  s_gear = 0; s_meas = false; s_tSeen = millis();
+  CFG::addSaveHook(persist);
+}
+
+void GEAR::onCut(){
+  const uint16_t r = RPMTRK::rpm();
+  if (!r) return;
+  s_pre = r; s_min = r; s_t0 = millis(); s_meas = true;
+}
+
+void GEAR::update(){
+  const uint16_t r = RPMTRK::rpm();
+  const uint32_t now = millis();
+  if (r) s_tSeen = now;
+  else if (now - s_tSeen > LOST_MS) s_gear = 0;
+  if (!s_meas) return;
+
+  if (!r) { s_meas = false; return; }
+  if (r < s_min) s_min = r;
+  const uint32_t el = now - s_t0;
+  // đáy = RPM đồng bộ với số mới; RPM hồi lên > 3% nghĩa là đã qua đáy
+  if ((el >= MIN_MS && r > s_min + (s_min >> 5)) || el >= WINDOW_MS) finish(s_min);
+}
+
+uint8_t  GEAR::current(){ return s_gear; }
+uint16_t GEAR::ratioQ12(uint8_t pair){ return (pair >= 1 && pair <= PAIRS) ? s_ratio[pair-1] : 0; }
+uint8_t  GEAR::samples(uint8_t pair){ return (pair >= 1 && pair <= PAIRS) ? s_n[pair-1] : 0; }
+uint16_t GEAR::lastRatioQ12(){ return s_last; }
+
+void GEAR::reset(){
+  memcpy(s_ratio, DEF_RATIO, sizeof(s_ratio));
+  memset(s_n, 0, sizeof(s_n));
+  save();
+  s_gear = 0;
+}
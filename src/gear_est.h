@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// Ước lượng số đang chạy không cần cảm biến tốc độ.
+// Mỗi lần sang số (lên), RPM sau cắt rơi về pre * ratio, ratio cố định theo cặp số.
+// Tỉ lệ từng cặp được học online từ RPMTRK (luồng cạnh RPM) và lưu NVS riêng ("gear"),
+// ghi bởi task "cfgsave" (CFG::addSaveHook), không trong task điều khiển.
+namespace GEAR {
+  static constexpr uint8_t MAX_GEAR = 6;
+  static constexpr uint8_t PAIRS    = MAX_GEAR - 1;   // cặp i: số i -> i+1 (1..PAIRS)
+
+  void begin();
+  void onCut();              // gọi khi vừa mở cắt sang số: chụp RPM trước khi sang
+  void update();             // gọi mỗi tick; gần như không tốn gì khi không đo
+  uint8_t current();         // số hiện tại, 0 = chưa biết
+  uint16_t ratioQ12(uint8_t pair);   // post/pre * 4096 đã học cho cặp (1..PAIRS)
+  uint8_t  samples(uint8_t pair);    // số lần học của cặp (bão hòa 255)
+  uint16_t lastRatioQ12();           // tỉ lệ đo được ở lần sang số gần nhất
+  void reset();              // xóa tỉ lệ đã học về mặc định
+}
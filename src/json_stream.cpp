@@ -0,0 +1,112 @@
+#include "json_stream.h"
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <math.h>
+
+void JSONS::Writer::put(char c){
+  if (n_ + 1 >= cap_) { ovf_ = true; return; }
+  b_[n_++] = c;
+}
+
+void JSONS::Writer::put(const char *s){ while (*s) put(*s++); }
+
+void JSONS::Writer::sep(){
+  if (keyed_) { keyed_ = false; return; }
+  if (!depth_) return;
+  const uint8_t bit = 1u << (depth_ - 1);
+  if (moreMask_ & bit) put(',');
+  moreMask_ |= bit;
+}
+
+void JSONS::Writer::key(const char *k){
+  sep(); str(k); put(':');
+  keyed_ = true;
+}
+
+void JSONS::Writer::open(const char *k, char c, bool isArr){
+  if (k) { key(k); keyed_ = false; } else sep();   // object/array chính là giá trị của khóa
+  put(c);
+  if (depth_ >= MAX_DEPTH) { ovf_ = true; return; }
+  const uint8_t bit = 1u << depth_;
+  if (isArr) arrMask_ |= bit; else arrMask_ &= ~bit;
+  moreMask_ &= ~bit;
+  depth_++;
+}
+
+void JSONS::Writer::end(){
+  if (!depth_) { ovf_ = true; return; }
+  depth_--;
+  put((arrMask_ >> depth_) & 1 ? ']' : '}');
+}
+
+void JSONS::Writer::str(const char *s){
+  put('"');
+  for (; s && *s; s++) {
+    const uint8_t c = (uint8_t)*s;
+    if (c == '"' || c == '\\') { put('\\'); put((char)c); }
+    else if (c < 0x20) {
+      char e[7]; snprintf(e, sizeof(e), "\\u%04x", c); put(e);
+    } else put((char)c);
+  }
+  put('"');
+}
+
+void JSONS::Writer::val(const char *s){ sep(); str(s); }
+
+void JSONS::Writer::val(float f){
+  sep();
+  if (isnan(f) || isinf(f)) { put("null"); return; }
+  char t[16]; snprintf(t, sizeof(t), "%g", (double)f); put(t);
+}
+
+void JSONS::Writer::num(long v){ char t[12]; snprintf(t, sizeof(t), "%ld", v); put(t); }
+void JSONS::Writer::unum(unsigned long v){ char t[12]; snprintf(t, sizeof(t), "%lu", v); put(t); }
+
+void JSONS::Writer::raw(const char *json){ sep(); put(json); }
+
+// ---------- Response chunked ----------
+namespace {
+struct Ctx {
+  JSONS::Gen gen;
+  JSONS::Writer w;
+  uint32_t step = 0;
+  uint16_t len = 0, off = 0;
+  bool done = false;
+  char stage[JSONS::STAGE];
+};
+uint32_t s_ovf = 0;   // chỉ task async_tcp ghi
+}
+
+uint32_t JSONS::overflows(){ return s_ovf; }
+
+void JSONS::send(AsyncWebServerRequest *req, Gen gen, const char *type){ send(req, 200, std::move(gen), type); }
+
+void JSONS::send(AsyncWebServerRequest *req, int code, Gen gen, const char *type){
+  auto c = std::make_shared<Ctx>();
+  c->gen = std::move(gen);
+  // closure giữ Ctx; response bị hủy (xong hoặc client đóng) -> Ctx và bản chụp của bên gọi được giải phóng
+  AsyncWebServerResponse *r = req->beginChunkedResponse(type, [c](uint8_t *out, size_t max, size_t) -> size_t {
+    size_t n = 0;
+    while (n < max) {
+      if (c->off < c->len) {
+        const size_t k = min((size_t)(c->len - c->off), max - n);
+        memcpy(out + n, c->stage + c->off, k);
+        c->off += k; n += k;
+        continue;
+      }
+      if (c->done) break;
+      c->w.reset(c->stage, sizeof(c->stage));
+      c->done = !c->gen(c->w, c->step++);
+      if (c->w.overflow()) {
+        // đơn vị lớn hơn STAGE: lỗi lập trình; cắt response thay vì gửi JSON sai lặng lẽ (đếm ở /api/task)
+        s_ovf++;
+        c->done = true; c->len = c->off = 0;
+        break;
+      }
+      c->len = (uint16_t)c->w.len(); c->off = 0;
+    }
+    return n;
+  });
+  r->setCode(code);
+  req->send(r);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <type_traits>
+
+class AsyncWebServerRequest;
+
+// JSON trả thẳng ra response chunked, không dựng String/JsonDocument.
+// Bên gọi chia tài liệu thành các "đơn vị" nhỏ (một nhóm khóa, một bản ghi log, một file);
+// mỗi lần TCP còn chỗ, đơn vị kế tiếp được ghi vào bộ đệm STAGE rồi chép sang gói gửi.
+// RAM mỗi request = một Ctx (~STAGE byte) + phần bên gọi giữ trong closure, không phụ thuộc độ dài.
+namespace JSONS {
+  static constexpr size_t STAGE = 512;     // đơn vị lớn nhất
+  static constexpr uint8_t MAX_DEPTH = 8;
+
+  // Ghi JSON vào bộ đệm cố định: tự chèn dấu phẩy, escape chuỗi, báo tràn (không ghi quá cap).
+  // Trạng thái lồng nhau giữ qua reset() nên một tài liệu trải được trên nhiều đơn vị.
+  class Writer {
+  public:
+    void reset(char *buf, size_t cap){ b_ = buf; cap_ = cap; n_ = 0; }
+    size_t len() const { return n_; }
+    bool overflow() const { return ovf_; }
+    const char* c_str(){ b_[n_] = '\0'; return b_; }   // put() luôn chừa 1 byte
+
+    void obj(const char *k = nullptr){ open(k, '{', false); }
+    void arr(const char *k = nullptr){ open(k, '[', true); }
+    void end();                               // đóng object/array trong cùng
+
+    void val(const char *s);                  // chuỗi (escape)
+    void val(bool b){ sep(); put(b ? "true" : "false"); }
+    void val(float f);                        // NaN/inf -> null
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+    val(T v){ sep(); if (std::is_signed<T>::value) num((long)v); else unum((unsigned long)v); }
+    void raw(const char *json);               // phần tử đã là JSON hợp lệ
+
+    template <typename T> void kv(const char *k, T v){ key(k); val(v); }
+
+  private:
+    void open(const char *k, char c, bool isArr);
+    void key(const char *k);
+    void sep();
+    void str(const char *s);
+    void put(char c);
+    void put(const char *s);
+    void num(long v);
+    void unum(unsigned long v);
+
+    char    *b_ = nullptr;
+    size_t   cap_ = 0, n_ = 0;
+    bool     ovf_ = false;
+    bool     keyed_ = false;                  // vừa ghi khóa: giá trị kế tiếp không cần dấu phẩy
+    uint8_t  depth_ = 0;
+    uint8_t  arrMask_ = 0, moreMask_ = 0;     // bit d: tầng d là array / đã có phần tử
+  };
+
+  // Ghi đơn vị thứ step vào w; trả true nếu còn đơn vị sau. Gọi tuần tự từ 0, mỗi step một lần.
+  using Gen = std::function<bool(Writer &w, uint32_t step)>;
+  void send(AsyncWebServerRequest *req, Gen gen, const char *type = "application/json");
+  void send(AsyncWebServerRequest *req, int code, Gen gen, const char *type = "application/json");
+  uint32_t overflows();                     // số response bị cắt vì một đơn vị vượt STAGE (lỗi lập trình)
+}
@@ -3,6 +3,7 @@
 #include "trigger_input.h"
 #include "cut_output.h"
 #include "pins.h"
+#include "rpm_rmt.h"
 
 #include "config.h"
 static inline CutLine toCutLine(CutOutputSel s) {
@@ -21,19 +22,22 @@ namespace {
   uint8_t  retries = 0;
   uint32_t t_start_window = 0;
 
-  QSConfig cfg() { return CFG::get(); }
+  const QSConfig& cfg() { return CFG::get(); }   // tham chiếu bản đang công bố, không chép
 
  // thay cho applyCutWhileLocked()
 void applyCutWhileLocked() {
-  auto c = CFG::get();
-  CUT::set(toCutLine(c.lock_cut_sel), true); // true = cắt
+  const auto &c = CFG::get();
+  // LOCK là chủ ưu tiên cao nhất: giữ line đã chọn, nhả line kia (nếu vừa đổi cấu hình)
+  const CutLine sel = toCutLine(c.lock_cut_sel);
+  CUT::hold(CutOwner::LOCK, sel, true);
+  CUT::hold(CutOwner::LOCK, sel == CutLine::IGN ? CutLine::INJ : CutLine::IGN, false);
 }
 
 // thay cho releaseCut()
 void releaseCut() {
-  // Tùy bạn muốn nhả cả 2 line hay chỉ line đang dùng.
-  CUT::set(CutLine::IGN, false);
-  CUT::set(CutLine::INJ, false);
+  // Chỉ nhả phần LOCK giữ; cắt của QS/backfire (nếu có) không bị thả theo
+  CUT::hold(CutOwner::LOCK, CutLine::IGN, false);
+  CUT::hold(CutOwner::LOCK, CutLine::INJ, false);
 }
 
 
@@ -52,14 +56,49 @@ void releaseCut() {
 
   // Phân loại nhịp thành 0/1 theo threshold
   bool classifyBit(uint32_t dur_ms, char &bitOut) {
-    auto c = cfg();
+    const auto &c = cfg();
     if (dur_ms < c.lock_short_ms_max) { bitOut = '0'; return true; }
     if (dur_ms >= c.lock_long_ms_min) { bitOut = '1'; return true; }
     return false; // vùng mờ không chấp nhận
   }
 
+  // ===== Cử chỉ chọn profile =====
+  // Khi không khóa và máy dưới rpm_min (QS không cắt): 1 nhịp dài + N nhịp ngắn, nghỉ > lock_gap_ms
+  // -> profile N (1..CFG::PROFILES). Phân loại nhịp như mã khóa.
+  Stage    pst = Stage::IDLE;
+  uint32_t p_press = 0, p_edge = 0;
+  uint8_t  p_short = 0;
+  bool     p_lead = false, p_bad = false;   // đã có nhịp dài mở đầu / chuỗi hỏng
+
+  void profileReset() { pst = Stage::IDLE; p_short = 0; p_lead = false; p_bad = false; }
+
+  void profileTick(const QSConfig &c, bool pressed, uint32_t now) {
+    switch (pst) {
+      case Stage::IDLE:
+        if (pressed) { pst = Stage::PRESSING; p_press = now; }
+        break;
+      case Stage::PRESSING:
+        if (!pressed) {
+          char bit;
+          if (!classifyBit(now - p_press, bit)) p_bad = true;
+          else if (bit == '1') { if (p_lead) p_bad = true; p_lead = true; }   // chỉ một nhịp dài, ở đầu
+          else if (!p_lead) p_bad = true;
+          else p_short++;
+          pst = Stage::GAP; p_edge = now;
+        }
+        break;
+      case Stage::GAP:
+        if (pressed) { pst = Stage::PRESSING; p_press = now; }
+        else if (now - p_edge > c.lock_gap_ms) {
+          if (!p_bad && p_lead && p_short >= 1 && p_short <= CFG::PROFILES) CFG::selectProfile(p_short - 1);
+          profileReset();
+        }
+        break;
+    }
+  }
+
   void checkSequenceDone() {
-    auto c = cfg();
+    const auto &c = cfg();
     // Khi khoảng nghỉ > gap hoặc đủ độ dài mã -> kết thúc và so sánh
     if (seq.length() >= strlen(c.lock_code)) {
       bool ok = (seq.substring(0, strlen(c.lock_code)) == String(c.lock_code));
@@ -69,7 +108,7 @@ void releaseCut() {
 }
 
 void LOCK::begin() {
-  auto c = cfg();
+  const auto &c = cfg();
   locked = c.lock_enabled;
   unlocked_pulse = false;
   retries = 0;
@@ -104,9 +143,14 @@ bool LOCK::justUnlocked() {
 }
 
 void LOCK::tick() {
-  auto c = cfg();
-  if (!c.lock_enabled) { locked = false; return; }
-  if (!locked) return;
+  const auto &c = cfg();
+  if (!c.lock_enabled) { if (locked) releaseCut(); locked = false; }
+  if (!locked) {
+    if (c.prof_gesture && RPM::get() < c.rpm_min) profileTick(c, TRIG::rawLevel(), millis());
+    else profileReset();
+    return;
+  }
+  profileReset();
 
   // Timeout & retry limit
   if (c.lock_timeout_s > 0 && (millis() - t_start_window) > (uint32_t)c.lock_timeout_s * 1000UL) {
@@ -168,15 +212,19 @@ void LOCK::tick() {
   applyCutWhileLocked();
 }
 
+bool LOCK::passOk(const String& pass){
+  return pass == String(CFG::snapshot().lock_code);   // gọi từ web: bản chép, không giữ tham chiếu
+}
+
+void LOCK::unlock(){
+  locked = false;
+  unlocked_pulse = true;  // cho UI biết vừa mở
+  // nhả cắt ngay khi mở:
+  releaseCut();
+}
+
 bool LOCK::adminUnlock(const String& pass){
-  auto c = CFG::get();
-  String code = String(c.lock_code);
-  if (pass == code) {
-    locked = false;
-    unlocked_pulse = true;  // cho UI biết vừa mở
-    // nhả cắt ngay khi mở:
-    CUT::set(toCutLine(c.lock_cut_sel), false);
-    return true;
-  }
-  return false;
+  if (!passOk(pass)) return false;
+  unlock();
+  return true;
 }
\ No newline at end of file
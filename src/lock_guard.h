@@ -10,5 +10,7 @@ namespace LOCK {
   bool justUnlocked();          // true duy nhất 1 lần ngay sau khi mở
   void forceLock();             // ép về trạng thái khóa (nếu cần)
   bool adminUnlock(const String& pass); // so pass với CFG::get().lock_code, mở khóa
+  bool passOk(const String& pass);      // chỉ so pass (web kiểm tra, task điều khiển mở)
+  void unlock();                        // mở khóa + nhả cắt, không kiểm tra
 
 }
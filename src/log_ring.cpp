@@ -1,33 +1,55 @@
 #include "log_ring.h"
-#include <ArduinoJson.h>
+#include <atomic>
 
 // Dùng uint16_t để tránh xung đột với size_t khi dùng min/so sánh
 static constexpr uint16_t RING_SZ = 64;
 static LogItem ring[RING_SZ];
-static volatile uint16_t head = 0; // next write index
+// s_head = seq của bản ghi kế tiếp (bản ghi seq nằm ở ring[seq % RING_SZ]); s_base = seq đầu sau clear
+static std::atomic<uint32_t> s_head{0};
+static std::atomic<uint32_t> s_base{0};
 
-void LOGR::begin(){ head = 0; }
+void LOGR::begin(){ s_head.store(0); s_base.store(0); }
 
 void LOGR::push(const LogItem &it){
-  // Snapshot biến volatile để tính toán nhất quán và tránh mismatch kiểu
-  uint16_t h = head;
+  const uint32_t h = s_head.load(std::memory_order_relaxed);
   ring[h % RING_SZ] = it;
-  head = h + 1;
+  s_head.store(h + 1, std::memory_order_release);
 }
 
-size_t LOGR::readAllToJson(String &out){
-  StaticJsonDocument<4096> d; JsonArray a = d.to<JsonArray>();
-  // Snapshot head một lần
-  uint16_t h = head;
-  // Thay min<> bằng toán tử 3 ngôi để tránh lỗi chọn overload
-  uint16_t cnt = (h < RING_SZ) ? h : RING_SZ;
-  for (uint16_t i = 0; i < cnt; i++){
-    const LogItem &it = ring[(uint16_t)((h - cnt + i) % RING_SZ)];
-    JsonObject o = a.createNestedObject();
-    o["t"]=it.ts_ms; o["rpm"]=it.rpm; o["cut"]=it.cut_ms; o["auto"]=it.auto_mode; o["bf"]=it.backfire; o["out"]=it.out; o["why"]=it.reason;
+uint32_t LOGR::seq(){ return s_head.load(std::memory_order_acquire); }
+
+// Chép bản ghi seq; false nếu producer đã (hoặc đang) ghi đè ô đó trong lúc chép
+static bool readItem(uint32_t s, LogItem &it){
+  it = ring[s % RING_SZ];
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return s_head.load(std::memory_order_relaxed) - s < RING_SZ;
+}
+
+int LOGR::itemToJson(char *buf, size_t cap, uint32_t s, const LogItem &it){
+  return snprintf(buf, cap, "{\"s\":%u,\"t\":%u,\"rpm\":%u,\"cut\":%u,\"act\":%u,\"auto\":%s,\"bf\":%s,\"out\":\"%.3s\",\"why\":\"%.7s\",\"load\":%u}",
+                  (unsigned)s, (unsigned)it.ts_ms, it.rpm, it.cut_ms, (unsigned)it.act_us,
+                  it.auto_mode ? "true" : "false", it.backfire ? "true" : "false", it.out, it.reason, it.load);
+}
+
+LOGR::Reader LOGR::openAll(){
+  const uint32_t h = s_head.load(std::memory_order_acquire);
+  const uint32_t cnt = min<uint32_t>(h - s_base.load(std::memory_order_relaxed), RING_SZ);
+  return Reader{h - cnt, h, false};
+}
+
+LOGR::Reader LOGR::openSince(uint32_t since){
+  Reader r = openAll();
+  if (since > r.h || since < r.s) r.reset = true;   // thiết bị khởi động lại / bị ghi đè / đã clear
+  else r.s = since;
+  return r;
+}
+
+bool LOGR::next(Reader &r, uint32_t &seq, LogItem &it){
+  while (r.s != r.h) {
+    seq = r.s++;
+    if (readItem(seq, it)) return true;            // vừa bị ghi đè trong lúc đọc -> bỏ
   }
-  serializeJson(d, out);
-  return cnt;
+  return false;
 }
 
-void LOGR::clear(){ head = 0; }
\ No newline at end of file
+void LOGR::clear(){ s_base.store(s_head.load()); }
@@ -2,12 +2,23 @@
 #include <Arduino.h>
 
 struct LogItem {
-  uint32_t ts_ms; uint16_t rpm; uint16_t cut_ms; bool auto_mode; bool backfire; char out[4]; char reason[8];
+  uint32_t ts_ms; uint16_t rpm; uint16_t cut_ms; uint32_t act_us; bool auto_mode; bool backfire; char out[4]; char reason[8];
+  uint16_t load;   // duty kim phun ‰ lúc cắt (0 = không đo)
 };
 
 namespace LOGR {
   void begin();
-  void push(const LogItem &it);
-  size_t readAllToJson(String &out);
+  void push(const LogItem &it);          // một producer (task điều khiển)
+  // Đọc tăng dần theo số thứ tự: mỗi bản ghi có seq tăng đơn điệu (không reset khi clear).
+  // Con trỏ đọc từng bản ghi (cho JSON stream): chụp head lúc mở, next() bỏ qua ô vừa bị ghi đè.
+  struct Reader { uint32_t s, h; bool reset; };
+  Reader openAll();                      // mọi bản ghi còn trong vòng
+  // Bản ghi seq >= since; r.h = seq kế tiếp. reset = true khi client đã mất bản ghi
+  // (since quá cũ, sau clear, hoặc thiết bị khởi động lại) -> đọc lại từ đầu vòng.
+  Reader openSince(uint32_t since);
+  bool next(Reader &r, uint32_t &seq, LogItem &it);
+  // Một bản ghi {"s",...} vào buf (snprintf); trả độ dài như snprintf
+  int itemToJson(char *buf, size_t cap, uint32_t seq, const LogItem &it);
+  uint32_t seq();                        // seq của bản ghi kế tiếp: bằng since của client = không có gì mới
   void clear();
 }
@@ -3,6 +3,8 @@
 #include "config_store.h"   // để dùng CFG::get()
 #include "log_ring.h"
 #include "rpm_rmt.h"
+#include "rpm_track.h"
+#include "gear_est.h"
 #include "trigger_input.h"
 #include "cut_output.h"
 #include "control_sm.h"
@@ -10,6 +12,7 @@
 #include "pwm_test.h"
 #include "lock_guard.h"  // dùng LOCK từ lock_guard.cpp
 #include "Backfire.h"
+#include "ctrl_task.h"
 
 // 1) Tạo instance:
 BackfireController backfire;
@@ -18,9 +21,17 @@ static uint16_t QS_GetRPM()            { return RPM::get(); }
 static bool     QS_IsCutBusy()         { return CUT::isActive(); } // đủ để tránh chồng xung
 static void     QS_RequestIgnCut(uint16_t ms) { 
   if (LOCK::isLocked()) return;        // khi khóa: chặn mọi cắt
-  CUT::pulse(CutLine::IGN, ms);        // không chặn loop
+  CUT::pulse(CutOwner::BF, CutLine::IGN, ms);        // không chặn loop
 }
 static bool     QS_IsIgnMode()         { return CFG::get().cut_output == CutOutputSel::IGN; }
+static int32_t  QS_GetDRPM()           { return RPMTRK::drpm(); }           // alpha-beta theo cạnh
+static void     QS_RequestIgnBurst(uint8_t n, uint16_t on_ms, uint16_t off_ms) {
+  if (LOCK::isLocked()) return;
+  const uint8_t k = CFG::get().backfire.skip_sparks;   // > 0: mỗi nhịp cắt k tia lửa
+  const uint32_t per = RPM::rpmToPeriod(RPM::get());
+  if (k && per) CUT::burstSparks(CutOwner::BF, CutLine::IGN, n, k, k * per, (uint32_t)off_ms * 1000UL);
+  else          CUT::burst(CutOwner::BF, CutLine::IGN, n, (uint32_t)on_ms * 1000UL, (uint32_t)off_ms * 1000UL);
+}
 
 /*
 
@@ -45,6 +56,9 @@ static bool QS_IsIgnMode() {
   return true;
 }
 */
+static void controlStep();
+static void controlExec(const CTASK::Msg &m);
+
 void setup(){
   Serial.begin(115200); delay(200);
   Serial.println("=== Quickshifter ESP32-C3 started ===");
@@ -54,16 +68,19 @@ void setup(){
 
   CFG::begin();
   LOGR::begin();
-  RPM::begin(PIN_RPM_IN);
-  TRIG::begin(PIN_SHIFT_NPN, 10);
+  RPM::begin(PIN_RPM_IN, CFG::get().rpm_backend, CFG::get().rpm_source, CFG::get().inj_active_low != 0);
+  RPMTRK::begin();
+  GEAR::begin();
+  TRIG::begin(PIN_SHIFT_NPN, CFG::get().debounce_shift_ms);
   CUT::begin(PIN_CUT_IGN, PIN_CUT_INJ);
+  RPM::setEdgeHook(CUT::onEdge);      // cắt theo số tia lửa bám cạnh RPM
   PWMTEST::begin(PIN_PWM_TEST);
   CTRL::begin();
   WEB::beginPortal();     // AP at boot; tự tắt theo ap_timeout_s
   LOCK::begin();          // bật cơ chế khóa theo config
 
   
-  const auto& c = CFG::get();
+  const QSConfig c = CFG::snapshot();   // portal đã chạy: bên ghi web có thể lật ô
 
 BackfireController::Config bf{};
 bf.enabled               = (c.bf_enable != 0);
@@ -80,12 +97,16 @@ bf.burst_off_ms          = c.bf_burst_off;
 bf.refractory_ms         = c.bf_refractory_ms;
 
 backfire.begin(bf, QS_GetRPM, QS_IsCutBusy, QS_RequestIgnCut, QS_IsIgnMode);
+backfire.setDrpmSource(QS_GetDRPM);
+backfire.setBurstSink(QS_RequestIgnBurst);
 
   backfire.markStarted(millis());
 
+  // khởi động sau cùng: từ đây đường cắt chạy ở task điều khiển 1 kHz
+  CTASK::begin(controlStep, controlExec);
 }
 
-// Cho phép cập nhật cấu hình Backfire động từ CFG (gọi sau /api/set)
+// Áp cấu hình Backfire từ phiên bản CFG đang công bố (controlStep gọi khi gen đổi)
 void BACKFIRE_applyConfigFromCFG(){
   const auto& c = CFG::get();
   BackfireController::Config bf{};
@@ -104,27 +125,48 @@ void BACKFIRE_applyConfigFromCFG(){
   backfire.setConfig(bf);
 }
 
-void loop(){
+// Một chu kỳ điều khiển (task CTASK, 1 kHz): khóa, QS, backfire, cắt
+static void controlStep(){
+  // Bộ ước lượng và tham số dẫn xuất chạy cả khi khóa: mở khóa xong không dùng trạng thái cũ
+  CTRL::update();
+
   // Ưu tiên xử lý khóa
-  LOCK::tick();
-  if (LOCK::isLocked()){
-    WEB::loop(); // vẫn cho cấu hình khi đang khóa
-    // heartbeat
-    static uint32_t t0=0; 
-    if (millis()-t0>500){ 
-      t0=millis(); 
-      digitalWrite(PIN_STATUS_LED, !digitalRead(PIN_STATUS_LED)); 
-    }
-    return; // chặn QS khi đang khóa
-  }
+  LOCK::tick();                 // khi đang khóa: chặn QS
 
   if (LOCK::justUnlocked()){
     // (Tùy chọn) mở portal 1 thời gian để tinh chỉnh
     // WEB::beginPortal();
   }
 
-  // QS bình thường
-  CTRL::tick();
+  // Mọi đường công bố (set, import, đổi profile, auto-tune) đều tăng gen -> backfire theo kịp
+  static uint32_t bfGen = 0;
+  if (CFG::params().gen != bfGen) {
+    bfGen = CFG::params().gen;
+    BACKFIRE_applyConfigFromCFG();
+  }
+
+  if (!LOCK::isLocked()) {
+    // QS bình thường
+    CTRL::tick();
+    backfire.tick(millis());
+  }
+  CFG::quiescent();             // hết chu kỳ: không còn giữ tham chiếu cấu hình cũ
+}
+
+// Lệnh từ web, chạy trong task điều khiển nên không tranh trạng thái với controlStep
+static void controlExec(const CTASK::Msg &m){
+  extern void CUT_testPulse(bool useIgn, uint16_t ms);
+  switch (m.cmd) {
+    case CTASK::Cmd::TEST_CUT:   CUT_testPulse(m.u8 != 0, m.u16); break;
+    case CTASK::Cmd::GEAR_RESET: GEAR::reset(); break;
+    case CTASK::Cmd::LOCK:       LOCK::forceLock(); break;
+    case CTASK::Cmd::UNLOCK:     LOCK::unlock(); break;
+    case CTASK::Cmd::PWM_TEST:   PWMTEST::enable(m.u8 != 0); PWMTEST::setSim(m.f0, m.f1); break;
+  }
+}
+
+// loop() = loopTask ưu tiên thấp: chỉ web/DNS và LED, đường cắt chạy ở CTASK
+void loop(){
   WEB::loop();
 
   // heartbeat
@@ -132,16 +174,8 @@ void loop(){
   if (millis()-t0>500){ 
     t0=millis(); 
     digitalWrite(PIN_STATUS_LED, !digitalRead(PIN_STATUS_LED)); 
-
-     uint32_t now = millis();
-  // ... code khác
-  backfire.tick(now);
   }
-  CUT::tick();
-backfire.tick(millis());
-
-
-
+  delay(1);
 }
 // GỌI HÀM NÀY Ở CHỖ VỪA NHẢ QUICKSHIFT CUT
 // (ngay sau khi bạn tắt rơ-le QS)
@@ -1,4 +1,7 @@
 #include "ota_update.h"
+#include "config_store.h"
+#include "json_stream.h"
+#include "web_ui.h"
 #include <Update.h>
 #include <LittleFS.h>
 #include <FS.h>
@@ -68,7 +71,7 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
       } else {
         sendJSON(req, 200, "FW update ok, rebooting...");
         req->client()->close(true);
-        delay(s_reboot_delay_ms);
+        CFG::flush(); delay(s_reboot_delay_ms);
         ESP.restart();
       }
     },
@@ -114,7 +117,7 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
       } else {
         sendJSON(req, 200, "FS image ok, rebooting...");
         req->client()->close(true);
-        delay(s_reboot_delay_ms);
+        CFG::flush(); delay(s_reboot_delay_ms);
         ESP.restart();
       }
     },
@@ -151,13 +154,15 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
 
   // ===== Backups: list and restore =====
   server.on("/api/backup/list", HTTP_GET, [&](AsyncWebServerRequest* req){
-    String out = "{";
-    out += "\"last_fw\":"; out += String(fileSizeOr0("/backup/last_fw.bin")); out += ",";
-    out += "\"orig_fw\":"; out += String(fileSizeOr0("/backup/orig_fw.bin")); out += ",";
-    out += "\"last_fs\":"; out += String(fileSizeOr0("/backup/last_fs.bin")); out += ",";
-    out += "\"orig_fs\":"; out += String(fileSizeOr0("/backup/orig_fs.bin"));
-    out += "}";
-    req->send(200, "application/json", out);
+    const size_t sz[4] = { fileSizeOr0("/backup/last_fw.bin"), fileSizeOr0("/backup/orig_fw.bin"),
+                            fileSizeOr0("/backup/last_fs.bin"), fileSizeOr0("/backup/orig_fs.bin") };
+    JSONS::send(req, [sz](JSONS::Writer &w, uint32_t){
+      w.obj();
+      w.kv("last_fw", sz[0]); w.kv("orig_fw", sz[1]);
+      w.kv("last_fs", sz[2]); w.kv("orig_fs", sz[3]);
+      w.end();
+      return false;
+    });
   });
 
   // GET /api/ota/restore?what=fw|fs&which=last|orig
@@ -185,7 +190,7 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
     f.close();
     if (!ok){ sendJSON(req, 500, "restore fail"); return; }
     sendJSON(req, 200, "restore ok; rebooting");
-    req->client()->close(true); delay(s_reboot_delay_ms); ESP.restart();
+    req->client()->close(true); CFG::flush(); delay(s_reboot_delay_ms); ESP.restart();
   });
 
   // ===== Upload 1 file vào LittleFS (ví dụ /index.html) =====
@@ -207,6 +212,8 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
         if (!path.startsWith("/")) path = "/" + path;
         // tạo thư mục nếu cần (đơn giản hoá: chỉ cho file gốc)
         if (LittleFS.exists(path)) LittleFS.remove(path);
+        // bản .gz cũ sẽ che bản vừa tải lên (sendAsset/fsUiTag ưu tiên .gz)
+        if (!path.endsWith(".gz") && LittleFS.exists(path + ".gz")) LittleFS.remove(path + ".gz");
         f = LittleFS.open(path, "w");
         if (!f){
           req->send(500, "application/json", "{\"ok\":false,\"msg\":\"open fail\"}");
@@ -218,6 +225,7 @@ void OTAHTTP_registerRoutes(AsyncWebServer& server){
       }
       if (final && f){
         f.close();
+        WEB::fsChanged();
       }
     });
 }
@@ -1,35 +1,282 @@
 #include "rpm_rmt.h"
 #include "pins.h"
+#include <soc/soc_caps.h>
+#include <hal/gpio_ll.h>
+#if SOC_RMT_SUPPORT_RX_PINGPONG
+#include <driver/rmt.h>
+#include <hal/rmt_ll.h>
+#include <soc/rmt_struct.h>
+#endif
 
-// Simple period-based mock (replace with real RMT if needed now).
-// For skeleton: measure pulse intervals via interrupt on PIN_RPM_IN.
+// Bắt cạnh RPM trên PIN_RPM_IN qua một trong hai backend:
+//  - GPIO: ngắt mỗi cạnh lên (fallback, luôn có)
+//  - RMT : bộ thu RMT lọc gai bằng phần cứng, ghi symbol vào RAM ping-pong;
+//          chỉ ngắt mỗi nửa block (24 symbol) hoặc khi hết xung (idle)
+// Cả hai chỉ đẩy timestamp vào ring (single-producer, lock-free); RPM::get() tự tính.
+// Nguồn kim phun dùng ngắt GPIO cả hai cạnh: lên = kim mở (cạnh RPM), xuống = kim đóng (độ rộng).
 
-static volatile uint32_t last_us = 0;
-static volatile uint32_t period_us = 0;
-static float g_ppr = 1.0f; static float g_scale = 1.0f;
+static constexpr uint32_t EDGE_RING   = 32;         // lũy thừa của 2
+static constexpr uint32_t EDGE_MASK   = EDGE_RING - 1;
+static constexpr uint8_t  MAX_AVG     = 16;         // < EDGE_RING để ISR không ghi đè vùng đang đọc
+static constexpr uint32_t MIN_PERIOD_US = 50;       // nhiễu
+static constexpr uint32_t TIMEOUT_US  = 500000;     // 0.5s không có cạnh -> 0 rpm
+static constexpr uint32_t RPM_CLAMP   = 20000;
 
+static volatile uint32_t s_edges[EDGE_RING];
+static volatile uint32_t s_head = 0;               // tổng số cạnh đã ghi (đơn điệu)
+static volatile uint32_t s_batch_us = 0;           // lần cuối backend giao cạnh (RMT giao theo lô)
+static RpmBackend s_backend = RpmBackend::GPIO;
+
+static RPM::EdgeHook s_hook = nullptr;
+static RpmSource s_source = RpmSource::COIL;
+
+static inline bool IRAM_ATTR pushEdge(uint32_t t){
+  const uint32_t h = s_head;
+  if (h && (t - s_edges[(h - 1) & EDGE_MASK]) <= MIN_PERIOD_US) return false;
+  s_edges[h & EDGE_MASK] = t;
+  s_head = h + 1;
+  return true;
+}
+
+// ===== Backend GPIO =====
 static void IRAM_ATTR isr(){
-  uint32_t now = micros();
-  uint32_t dt = now - last_us; last_us = now; if (dt>50 && dt<1000000) period_us = dt;
+  const uint32_t now = micros();
+  if (pushEdge(now) && s_hook) s_hook();
+  s_batch_us = now;
+}
+
+// ===== Nguồn kim phun (GPIO, cả hai cạnh) =====
+// Kim đóng -> cuộn dây xả flyback (hàng chục V) và dao động vài trăm µs: bỏ mọi cạnh
+// trong INJ_BLANK_US sau cạnh đóng. Xung mở ngắn hơn INJ_MIN_US là nhiễu, không tính rộng.
+static constexpr uint32_t INJ_BLANK_US = 400;
+static constexpr uint32_t INJ_MIN_US   = 300;
+static constexpr uint8_t  INJ_AVG      = 4;                 // lũy thừa của 2
+
+static uint8_t  s_injPin = 0;
+static bool     s_injLow = true;                            // mức thấp = kim mở
+static bool     s_injOpen = false;
+static uint32_t s_injT0 = 0, s_injClose = 0;
+static volatile uint32_t s_injW[INJ_AVG];
+static volatile uint32_t s_injN = 0, s_injRej = 0;
+
+static void IRAM_ATTR injIsr(){
+  const uint32_t now = micros();
+  const bool lv = (gpio_ll_get_level(&GPIO, (gpio_num_t)s_injPin) != 0) != s_injLow;   // true = kim mở
+  if (s_injClose && now - s_injClose < INJ_BLANK_US) { s_injRej++; return; }
+  if (lv && !s_injOpen) {
+    s_injOpen = true; s_injT0 = now;
+  } else if (!lv && s_injOpen) {
+    s_injOpen = false; s_injClose = now;
+    const uint32_t w = now - s_injT0;
+    if (w < INJ_MIN_US) { s_injRej++; return; }
+    // xung hợp lệ mới ghi cạnh RPM (mốc = lúc mở); trễ một độ rộng nên không gọi edge hook
+    pushEdge(s_injT0);
+    s_batch_us = now;
+    s_injW[s_injN & (INJ_AVG - 1)] = w;
+    s_injN = s_injN + 1;
+  } else {
+    s_injRej++;                                              // cạnh lặp cùng mức: gai
+  }
 }
 
-void RPM::begin(uint8_t pin){
+// ===== Backend RMT =====
+#if SOC_RMT_SUPPORT_RX_PINGPONG
+static constexpr rmt_channel_t RMT_RX_CH   = RMT_CHANNEL_2;  // kênh RX đầu tiên trên C3
+static constexpr uint32_t RMT_RX_IDX       = 0;              // chỉ số kênh RX trong thanh ghi
+static constexpr uint32_t RMT_MEM_ITEMS    = 48;             // 1 block
+static constexpr uint32_t RMT_HALF         = RMT_MEM_ITEMS / 2;
+static constexpr uint16_t RMT_IDLE_TICKS   = 32767;          // 1 tick = 1µs (clk_div 80)
+static constexpr uint8_t  RMT_FILTER_TICKS = 255;            // lọc gai < ~3.2µs (đơn vị APB 80MHz)
+
+static rmt_isr_handle_t s_rmt_isr = nullptr;
+static uint32_t s_rmt_pos = 0;                               // nửa block kế tiếp cần đọc
+
+// Chuyển các symbol [from, to) thành cạnh lên; tEnd = thời điểm cạnh kết thúc symbol cuối
+static void IRAM_ATTR rmtDecode(uint32_t from, uint32_t to, uint32_t tEnd){
+  volatile uint32_t *mem = &RMTMEM.chan[RMT_RX_CH].data32[0].val;
+  uint32_t n = 0, total = 0;
+  uint32_t half[2 * RMT_HALF];                               // (duration<<1)|level theo thứ tự
+  for (uint32_t i = from; i < to; i++) {
+    const uint32_t v = mem[i];
+    const uint32_t d0 = v & 0x7FFF, d1 = (v >> 16) & 0x7FFF;
+    if (d0 == 0) break;
+    half[n++] = (d0 << 1) | ((v >> 15) & 1); total += d0;
+    if (d1 == 0) break;                                      // dấu kết thúc khung
+    half[n++] = (d1 << 1) | (v >> 31); total += d1;
+  }
+  // Dựng lại thời điểm tuyệt đối: đi tới từ đầu khung con, mốc = tEnd - tổng thời lượng
+  uint32_t t = tEnd - total;
+  for (uint32_t i = 0; i < n; i++) {
+    if (half[i] & 1) pushEdge(t);                            // nửa mức cao bắt đầu bằng cạnh lên
+    t += half[i] >> 1;
+  }
+}
+
+static void IRAM_ATTR rmtIsr(void*){
+  const uint32_t now = micros();
+  const uint32_t thr = rmt_ll_get_rx_thres_interrupt_status(&RMT);
+  const uint32_t end = rmt_ll_get_rx_end_interrupt_status(&RMT);
+  if (thr & (1u << RMT_RX_IDX)) {
+    // Nửa block đầy: symbol cuối vừa kết thúc tại cạnh hiện tại
+    rmtDecode(s_rmt_pos, s_rmt_pos + RMT_HALF, now);
+    s_rmt_pos = (s_rmt_pos + RMT_HALF) % RMT_MEM_ITEMS;
+    rmt_ll_rx_set_mem_owner(&RMT, RMT_RX_IDX, RMT_MEM_OWNER_RX);
+    rmt_ll_clear_rx_thres_interrupt(&RMT, RMT_RX_IDX);
+  }
+  if (end & (1u << RMT_RX_IDX)) {
+    // Hết khung vì idle: cạnh cuối xảy ra trước đó RMT_IDLE_TICKS µs
+    rmtDecode(s_rmt_pos, s_rmt_pos + RMT_HALF, now - RMT_IDLE_TICKS);
+    rmt_ll_rx_enable(&RMT, RMT_RX_IDX, false);
+    rmt_ll_rx_reset_pointer(&RMT, RMT_RX_IDX);
+    s_rmt_pos = 0;
+    rmt_ll_rx_set_mem_owner(&RMT, RMT_RX_IDX, RMT_MEM_OWNER_RX);
+    rmt_ll_clear_rx_end_interrupt(&RMT, RMT_RX_IDX);
+    rmt_ll_rx_enable(&RMT, RMT_RX_IDX, true);
+  }
+  s_batch_us = now;
+}
+
+static bool rmtBegin(uint8_t pin){
+  rmt_config_t c = RMT_DEFAULT_CONFIG_RX((gpio_num_t)pin, RMT_RX_CH);
+  c.clk_div                       = 80;                // 1µs / tick
+  c.mem_block_num                 = 1;
+  c.rx_config.filter_en           = true;
+  c.rx_config.filter_ticks_thresh = RMT_FILTER_TICKS;
+  c.rx_config.idle_threshold      = RMT_IDLE_TICKS;
+  if (rmt_config(&c) != ESP_OK) return false;
+  if (rmt_isr_register(rmtIsr, nullptr, ESP_INTR_FLAG_IRAM, &s_rmt_isr) != ESP_OK) return false;
+  rmt_ll_enable_mem_access(&RMT, true);
+  rmt_ll_rx_enable_pingpong(&RMT, RMT_RX_IDX, true);
+  rmt_set_rx_thr_intr_en(RMT_RX_CH, true, RMT_HALF);
+  rmt_set_rx_intr_en(RMT_RX_CH, true);
+  rmt_rx_memory_reset(RMT_RX_CH);
+  rmt_set_memory_owner(RMT_RX_CH, RMT_MEM_OWNER_RX);
+  s_rmt_pos = 0;
+  rmt_ll_rx_enable(&RMT, RMT_RX_IDX, true);
+  return true;
+}
+#else
+static bool rmtBegin(uint8_t){ return false; }
+#endif
+
+static uint32_t g_k = 60000000UL;                   // rpm = g_k / period_us (đã gồm ppr, scale)
+static uint8_t  g_n = 4; static bool g_median = false;
+
+void RPM::begin(uint8_t pin, RpmBackend be, RpmSource src, bool injActiveLow){
   pinMode(pin, INPUT_PULLUP);
+  s_source = src;
+  if (src == RpmSource::INJECTOR) {
+    // cần thời điểm cả hai cạnh ngay lúc xảy ra: RMT giao theo lô nên không dùng
+    s_injPin = pin; s_injLow = injActiveLow; s_injOpen = false; s_injClose = 0; s_injN = 0;
+    s_backend = RpmBackend::GPIO;
+    attachInterrupt(digitalPinToInterrupt(pin), injIsr, CHANGE);
+    return;
+  }
+  if (be == RpmBackend::RMT && rmtBegin(pin)) { s_backend = RpmBackend::RMT; return; }
+  s_backend = RpmBackend::GPIO;
   attachInterrupt(digitalPinToInterrupt(pin), isr, RISING);
 }
 
-void RPM::setPPR(float ppr){ g_ppr = max(0.1f, ppr); }
-void RPM::setScale(float s){ g_scale = (s<=0?1.0f:s); }
+RpmBackend RPM::backend(){ return s_backend; }
+RpmSource  RPM::source(){ return s_source; }
+
+static uint32_t injWidth(uint16_t rpm){
+  const uint32_t n = s_injN;
+  if (s_source != RpmSource::INJECTOR || !n || !rpm) return 0;
+  const uint8_t c = (uint8_t)min<uint32_t>(n, INJ_AVG);
+  uint32_t sum = 0;
+  for (uint8_t i=0;i<c;i++) sum += s_injW[(n - 1 - i) & (INJ_AVG - 1)];
+  return (sum + c/2) / c;
+}
+
+uint32_t RPM::injWidthUs(){ return injWidth(RPM::get()); }
+
+uint16_t RPM::injDuty(){
+  // một lần lọc: rộng và chu kỳ cùng một giá trị rpm
+  const uint16_t rpm = RPM::get();
+  const uint32_t w = injWidth(rpm);
+  if (!w) return 0;
+  // chu kỳ giữa hai lần mở = chu kỳ cạnh RPM hiện tại (ngược từ rpm đã lọc)
+  const uint32_t p = RPM::rpmToPeriod(rpm);
+  if (!p) return 0;
+  return (uint16_t)min<uint32_t>(1000, (w * 1000UL + p/2) / p);
+}
+
+uint32_t RPM::injRejected(){ return s_injRej; }
+
+uint32_t RPM::edgeHead(){ return s_head; }
+
+void RPM::setEdgeHook(EdgeHook fn){ s_hook = fn; }
+
+size_t RPM::readEdges(uint32_t &cursor, uint32_t *ts, size_t max){
+  const uint32_t h = s_head;
+  // Giữ biên an toàn: ISR có thể đang ghi ô kế tiếp
+  if (h - cursor > EDGE_RING - 2) cursor = h - (EDGE_RING - 2);
+  size_t n = 0;
+  while (cursor != h && n < max) { ts[n++] = s_edges[cursor & EDGE_MASK]; cursor++; }
+  return n;
+}
+
+void RPM::setK(uint32_t k){ if (k) g_k = k; }
+
+void RPM::setFilter(uint8_t n, bool median){
+  g_n = constrain(n, (uint8_t)1, MAX_AVG);
+  g_median = median;
+}
+
+// Sắp xếp chèn, n <= 16
+static void sortPeriods(uint32_t *p, uint8_t n){
+  for (uint8_t i=1;i<n;i++){
+    const uint32_t v = p[i]; int8_t j = i-1;
+    while (j>=0 && p[j]>v){ p[j+1]=p[j]; j--; }
+    p[j+1]=v;
+  }
+}
 
 uint16_t RPM::get(){
-  uint32_t p = period_us; if (p==0) return 0;
-  // timeout if too old
-  if ((micros() - last_us) > 500000) return 0; // 0.5s
-  float rpm = 60.0f * 1e6f / (float(p) * g_ppr);
-  rpm *= g_scale;
+  uint32_t per[MAX_AVG]; uint8_t n; uint32_t last;
+  // Chụp n chu kỳ gần nhất; đọc lại nếu ISR đã chạy quá xa trong lúc đọc
+  for (;;) {
+    const uint32_t h = s_head;
+    if (h < 2) return 0;
+    n = (uint8_t)min<uint32_t>(g_n, h - 1);
+    last = s_edges[(h - 1) & EDGE_MASK];
+    uint32_t t = last;
+    for (uint8_t i=0;i<n;i++){
+      const uint32_t prev = s_edges[(h - 2 - i) & EDGE_MASK];
+      per[i] = t - prev; t = prev;
+    }
+    if ((s_head - h) < (EDGE_RING - MAX_AVG - 1)) break;
+  }
+  // timeout if too old (RMT giao cạnh theo lô: tính từ lần giao cuối)
+  const uint32_t now = micros();
+  if ((now - last) > TIMEOUT_US && (now - s_batch_us) > TIMEOUT_US) return 0;
+
+  sortPeriods(per, n);
+  const uint32_t med = per[n/2];
+  uint32_t p = med;
+  if (!g_median && n > 2) {
+    // Trung bình các chu kỳ trong ±25% trung vị (loại xung nhiễu/mất xung)
+    const uint32_t lo = med - (med >> 2), hi = med + (med >> 2);
+    uint32_t sum = 0; uint8_t cnt = 0;
+    for (uint8_t i=0;i<n;i++) if (per[i]>=lo && per[i]<=hi){ sum += per[i]; cnt++; }
+    if (cnt) p = (sum + cnt/2) / cnt;
+  } else if (!g_median && n == 2) {
+    p = (per[0] + per[1] + 1) >> 1;
+  }
+  return RPM::periodToRpm(p);
+}
+
+uint32_t RPM::rpmToPeriod(uint16_t rpm){
+  return rpm ? (g_k + rpm/2) / rpm : 0;
+}
+
+uint16_t RPM::periodToRpm(uint32_t p){
+  if (p == 0) return 0;
+  uint32_t rpm = (g_k + p/2) / p;
   // crude clamp
-  if (rpm<0) rpm=0; if (rpm>20000) rpm=20000;
+  if (rpm > RPM_CLAMP) rpm = RPM_CLAMP;
   return (uint16_t)rpm;
 }
 // thêm ở cuối file
-uint16_t RPM_get(){ return RPM::get(); }
\ No newline at end of file
+uint16_t RPM_get(){ return RPM::get(); }
@@ -1,11 +1,37 @@
 
 #pragma once
 #include <Arduino.h>
+#include "config.h"
 
 namespace RPM {
-  void begin(uint8_t pin);
-  void setPPR(float ppr);
-  void setScale(float s);
+  // src = INJECTOR: bắt cả hai cạnh trên cùng chân (luôn dùng backend GPIO) để đo
+  // thêm độ rộng xung phun; cạnh lên (kim mở) vẫn là cạnh RPM, ghi khi xung đã hợp lệ
+  // (không gọi edge hook: cắt theo tia lửa khi đó chạy theo thời gian).
+  // injActiveLow: mức chân khi kim mở (xem QSConfig::inj_active_low).
+  void begin(uint8_t pin, RpmBackend be = RpmBackend::GPIO, RpmSource src = RpmSource::COIL, bool injActiveLow = true);
+  void setK(uint32_t k);    // rpm = k / chu kỳ (µs); k = 60e6 * scale / ppr, biên dịch sẵn trong CtrlParams
   uint16_t get(); // filtered rpm (0 if timeout)
+
+  // Bộ lọc N cạnh: n = số chu kỳ (1..16), median = true -> trung vị, false -> trung bình đã loại outlier
+  void setFilter(uint8_t n, bool median);
+  uint16_t periodToRpm(uint32_t period_us); // chu kỳ -> rpm (đã gồm ppr, scale), chia nguyên
+  uint32_t rpmToPeriod(uint16_t rpm);       // ngược lại: rpm -> chu kỳ cạnh (µs)
+
+  RpmBackend backend();     // backend đang chạy (RMT lỗi -> GPIO)
+  RpmSource  source();
+
+  // Kim phun (chỉ khi source() == INJECTOR; 0 nếu không có tín hiệu)
+  uint32_t injWidthUs();    // độ rộng mở kim, trung bình 4 xung gần nhất
+  uint16_t injDuty();       // duty = rộng / chu kỳ, ‰ (0..1000): chỉ số tải động cơ
+  uint32_t injRejected();   // số cạnh bị bỏ vì dao động flyback hoặc xung quá ngắn
+
+  // Dòng cạnh chung cho mọi backend (timestamp µs, theo thứ tự thời gian).
+  // Mỗi consumer giữ cursor riêng; bị bỏ lại quá xa thì cursor nhảy tới cạnh cũ nhất còn giữ.
+  uint32_t edgeHead();      // tổng số cạnh đã ghi
+  size_t readEdges(uint32_t &cursor, uint32_t *ts, size_t max);
+
+  // Hàm gọi ngay trong ISR mỗi cạnh hợp lệ (chỉ backend GPIO; RMT giao cạnh theo lô nên trễ)
+  using EdgeHook = void (*)();
+  void setEdgeHook(EdgeHook fn);
 }
 #pragma once
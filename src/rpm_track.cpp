@@ -0,0 +1,72 @@
+#include "rpm_track.h"
+#include "rpm_rmt.h"
+
+static constexpr uint32_t TIMEOUT_US   = 500000; // mất cạnh quá lâu -> reset
+static constexpr uint8_t  MAX_REJECT   = 3;      // loại liên tiếp quá số này -> bám lại đo đạc
+static constexpr uint8_t  BATCH        = 16;
+static constexpr int32_t  V_CLAMP      = 200000L << 8; // |dRPM/dt| tối đa, Q8
+
+static uint8_t  g_alpha = 77, g_beta = 13;       // ~0.30 / ~0.05 (gần tắt dần tới hạn)
+static uint32_t s_cursor = 0;
+static uint32_t s_lastEdge = 0;
+static bool     s_havePrev = false, s_valid = false;
+static int32_t  s_x = 0;                         // rpm, Q8
+static int32_t  s_v = 0;                         // rpm/s, Q8
+static uint8_t  s_rejRun = 0;
+static uint32_t s_rejected = 0;
+static volatile uint16_t s_rpm = 0;
+static volatile int32_t  s_drpm = 0;
+
+static void reset(){ s_valid = false; s_x = 0; s_v = 0; s_rejRun = 0; s_rpm = 0; s_drpm = 0; }
+
+// Một bước alpha-beta với chu kỳ dt (µs)
+static void step(uint32_t dt){
+  const int32_t z = (int32_t)RPM::periodToRpm(dt) << 8;
+  if (!s_valid) { s_x = z; s_v = 0; s_valid = true; return; }
+
+  const int32_t xp = s_x + (int32_t)(((int64_t)s_v * dt) / 1000000);
+  const int32_t r  = z - xp;
+  // Lệch > 30% dự đoán: mất xung / xung thừa -> bỏ qua, trừ khi lặp lại liên tục
+  const int32_t lim = (xp >> 2) + (xp >> 4) + (xp >> 5);
+  if ((r > lim || r < -lim) && s_rejRun < MAX_REJECT) {
+    s_rejRun++; s_rejected++;
+    s_x = xp;
+    return;
+  }
+  if (s_rejRun >= MAX_REJECT) { s_x = z; s_v = 0; s_rejRun = 0; return; }
+  s_rejRun = 0;
+  s_x = xp + (int32_t)(((int64_t)g_alpha * r) >> 8);
+  const int64_t v = s_v + ((((int64_t)g_beta * r) >> 8) * 1000000 / (int64_t)dt);
+  s_v = (int32_t)constrain(v, (int64_t)-V_CLAMP, (int64_t)V_CLAMP);
+}
+
+void RPMTRK::begin(){ s_cursor = RPM::edgeHead(); s_havePrev = false; reset(); }
+
+void RPMTRK::setGains(uint8_t alpha_q8, uint8_t beta_q8){
+  g_alpha = alpha_q8 ? alpha_q8 : 1;
+  g_beta  = beta_q8;
+}
+
+void RPMTRK::update(){
+  uint32_t ts[BATCH]; size_t n;
+  while ((n = RPM::readEdges(s_cursor, ts, BATCH)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      const uint32_t t = ts[i];
+      if (s_havePrev) {
+        const uint32_t dt = t - s_lastEdge;
+        if (dt > TIMEOUT_US) reset();
+        else if (dt) step(dt);
+      }
+      s_lastEdge = t; s_havePrev = true;
+    }
+  }
+  if (s_havePrev && (micros() - s_lastEdge) > TIMEOUT_US) { reset(); return; }
+  if (!s_valid) return;
+  const int32_t x = s_x < 0 ? 0 : (s_x >> 8);
+  s_rpm  = (uint16_t)min<int32_t>(x, 20000);
+  s_drpm = s_v >> 8;
+}
+
+uint16_t RPMTRK::rpm(){ return s_rpm; }
+int32_t  RPMTRK::drpm(){ return s_drpm; }
+uint32_t RPMTRK::rejected(){ return s_rejected; }
@@ -0,0 +1,13 @@
+#pragma once
+#include <Arduino.h>
+
+// Bộ lọc alpha-beta cho RPM và gia tốc góc (dRPM/dt), cập nhật tại MỖI cạnh RPM.
+// Toàn bộ số học là fixed-point (Q8), đọc cạnh từ RPM::readEdges().
+namespace RPMTRK {
+  void begin();
+  void setGains(uint8_t alpha_q8, uint8_t beta_q8); // alpha, beta * 256
+  void update();            // gọi thường xuyên: xử lý mọi cạnh mới
+  uint16_t rpm();           // RPM đã lọc (0 nếu mất tín hiệu)
+  int32_t  drpm();          // dRPM/dt (rpm/s), âm = giảm tốc
+  uint32_t rejected();      // số cạnh bị loại vì lệch quá xa dự đoán
+}
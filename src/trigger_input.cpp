@@ -1,13 +1,76 @@
 #include "trigger_input.h"
 #include "pins.h"
-static uint8_t gpin; static uint16_t gdeb; static uint32_t last_ms=0; static bool last=false;
-void TRIG::begin(uint8_t pin, uint16_t debounce_ms){ gpin=pin; gdeb=debounce_ms; pinMode(pin, INPUT_PULLUP); }
-bool TRIG::pressed(){ bool v = (digitalRead(gpin)==LOW); uint32_t now=millis(); if (v!=last){ last=v; last_ms=now; }
-  if (v && (now-last_ms)>=gdeb) return true; return false; }
-static uint8_t sPin = 0;
-static bool sLevel = false; // true = đang nhấn (tùy cách bạn định nghĩa)
-bool TRIG::rawLevel(){ return sLevel; }
-// Active-low theo code hiện tại
-static inline bool shiftPressedRaw() {
-  return digitalRead(PIN_SHIFT_NPN) == LOW;
-}
\ No newline at end of file
+#include <hal/gpio_ll.h>
+
+// Cạnh đảo lại trong ngưỡng này tính từ cạnh trước là gai: cạnh trước bị hoàn tác
+static constexpr uint32_t GLITCH_US  = 200;
+
+static uint8_t gpin; static volatile uint32_t gdeb_us = 10000;
+static volatile bool     sLevel = false;      // mức thô, true = đang nhấn (active-low)
+static volatile uint32_t sEdgeUs = 0;         // thời điểm cạnh gần nhất (micros)
+static volatile uint32_t sPrevUs = 0;         // thời điểm cạnh trước đó (để hoàn tác gai)
+static volatile uint32_t sGlitches = 0;
+static volatile bool     sHookFired = false;  // cạnh nhấn gần nhất đã kích fast path
+static volatile TRIG::PressHook  sHook = nullptr;
+static volatile TRIG::CancelHook sCancel = nullptr;
+static bool sStable = false;                   // mức đã debounce (cho LOCK)
+
+static inline bool IRAM_ATTR readPressed(){
+  return gpio_ll_get_level(&GPIO, (gpio_num_t)gpin) == 0;
+}
+
+// ISR: đóng dấu thời gian từng cạnh; debounce/loại nhiễu làm trên timestamp.
+// Gai ngắn hơn độ trễ vào ISR bị bỏ luôn (đọc lại mức thấy không đổi); gai dài hơn
+// bị hoàn tác ở cạnh sau: mức và timestamp trở về như trước gai, nên không khởi động
+// lại cửa sổ debounce của pressed()/rawLevel().
+static void IRAM_ATTR isr(){
+  const uint32_t now = micros();
+  const bool v = readPressed();
+  if (v == sLevel) return;                     // cạnh đã được xử lý
+  const uint32_t dt = now - sEdgeUs;
+  if (dt < GLITCH_US) {
+    sGlitches++;
+    sLevel = v; sEdgeUs = sPrevUs;
+    if (sHookFired) { sHookFired = false; if (sCancel) sCancel(); }
+    return;
+  }
+  sPrevUs = sEdgeUs; sLevel = v; sEdgeUs = now;
+  sHookFired = false;
+  // Cạnh nhấn chỉ kích fast path khi trước đó đã nhả ổn định >= debounce
+  if (!v || !sHook || dt < gdeb_us) return;
+  sHookFired = true;
+  sHook(now);
+}
+
+void TRIG::begin(uint8_t pin, uint16_t debounce_ms){
+  gpin=pin; gdeb_us=(uint32_t)debounce_ms*1000UL;
+  pinMode(pin, INPUT_PULLUP);
+  sLevel = (digitalRead(pin)==LOW); sEdgeUs = micros() - gdeb_us; sPrevUs = sEdgeUs - GLITCH_US;
+  attachInterrupt(digitalPinToInterrupt(pin), isr, CHANGE);
+}
+
+// Đọc cặp (mức, thời điểm) nhất quán với ISR. Cạnh còn trong cửa sổ nhiễu chưa được tính:
+// trả mức/thời điểm trước nó, nên gai không làm pressed() chớp tắt giữa lúc đang giữ.
+static inline void snapshot(bool &v, uint32_t &t){
+  uint32_t p;
+  do { t = sEdgeUs; p = sPrevUs; v = sLevel; } while (t != sEdgeUs);
+  if (micros() - t < GLITCH_US) { v = !v; t = p; }
+}
+
+void TRIG::setDebounce(uint16_t debounce_ms){ gdeb_us=(uint32_t)debounce_ms*1000UL; }
+
+// Đang nhấn và giữ ổn định >= debounce (tính từ timestamp của ISR)
+bool TRIG::pressed(){
+  bool v; uint32_t t; snapshot(v, t);
+  return v && (micros()-t) >= gdeb_us;
+}
+
+// Mức đã debounce: chỉ nhận mức thô khi nó giữ ổn định >= debounce
+bool TRIG::rawLevel(){
+  bool v; uint32_t t; snapshot(v, t);
+  if ((micros()-t) >= gdeb_us) sStable = v;
+  return sStable;
+}
+uint32_t TRIG::lastEdgeUs(){ return sEdgeUs; }
+uint32_t TRIG::glitchCount(){ return sGlitches; }
+void TRIG::setPressHook(PressHook fn, CancelHook cancel){ sCancel = cancel; sHook = fn; }
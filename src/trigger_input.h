@@ -1,8 +1,16 @@
 #pragma once
 #include <Arduino.h>
-namespace TRIG { void begin(uint8_t pin, uint16_t debounce_ms); bool pressed();   void tick();
-  bool fell();   // cạnh
-  bool rose();   // cạnh
-  bool rawLevel(); // <-- thêm}
-}
+namespace TRIG { void begin(uint8_t pin, uint16_t debounce_ms); bool pressed();
+  bool rawLevel(); // mức đã debounce (true = đang nhấn)
+
+  // Cạnh được bắt bằng ngắt GPIO, đóng dấu thời gian theo µs
+  void setDebounce(uint16_t debounce_ms);
+  uint32_t lastEdgeUs();   // thời điểm cạnh hợp lệ gần nhất (micros)
+  uint32_t glitchCount();  // số xung nhiễu bị loại
 
+  // Fast path: hook gọi TRONG ISR ngay tại cạnh nhấn hợp lệ (phải là IRAM_ATTR).
+  // Cạnh nhấn đó hóa ra là gai (nhả lại trong cửa sổ nhiễu) -> gọi cancel, cũng trong ISR.
+  using PressHook  = void (*)(uint32_t t_us);
+  using CancelHook = void (*)();
+  void setPressHook(PressHook fn, CancelHook cancel = nullptr);
+}
@@ -1,6 +1,7 @@
 // web_ui.cpp
 #include "web_ui.h"
 #include <WiFi.h>
+#include <esp_wifi.h>
 #include <DNSServer.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
@@ -8,11 +9,26 @@
 #include "log_ring.h"
 #include "pwm_test.h"
 #include "lock_guard.h"
+#include "cut_output.h"
+#include "rpm_track.h"
+#include "cut_map.h"
+#include "gear_est.h"
+#include "auto_tune.h"
+#include "rpm_rmt.h"
+#include "ctrl_task.h"
+#include "json_stream.h"
 
 #include <Arduino.h>
 #include "FS.h"
 #include "LittleFS.h"
 #include "ota_update.h"
+#include <esp_rom_crc.h>
+#if __has_include("ui_embed.h")
+#include "ui_embed.h"            // sinh bởi tools/gzip_assets.py lúc build
+#define UI_EMBED 1
+#else
+#define UI_EMBED 0
+#endif
 
 // ...
 
@@ -29,6 +45,229 @@ static uint32_t lastHit   = 0;
 static bool     running   = false; // portal is running
 static bool     holdPortal= false; // keep AP on while UI is open
 
+// Bản chép cấu hình cho loopTask (evTick, WEB::loop): chỉ chép lại (CFG::snapshot) khi gen đổi.
+// Handler async_tcp không dùng bản này mà tự gọi CFG::snapshot().
+static QSConfig loopCfgCopy;
+static uint32_t loopCfgGen = 0;
+static bool     loopCfgOk = false;
+static const QSConfig& loopCfg() {
+  const uint32_t g = CFG::gen();
+  if (!loopCfgOk || g != loopCfgGen) { loopCfgCopy = CFG::snapshot(); loopCfgGen = g; loopCfgOk = true; }
+  return loopCfgCopy;
+}
+
+// ===================== Static assets: .gz + ETag =====================
+// tools/gzip_assets.py nén sẵn data/ -> <file>.gz. Trả bản .gz nếu có (trình duyệt nhận gzip),
+// ETag mạnh = CRC32 nội dung file thật sự gửi, tính một lần rồi nhớ theo (path, size, lastWrite).
+// Cache-Control: no-cache -> trình duyệt luôn hỏi lại, nhưng chỉ nhận 304 khi không đổi.
+struct EtagEntry { String path; size_t size; time_t lw; char tag[12]; };
+static EtagEntry etags[6];
+static uint8_t   etagNext = 0;
+
+static const char* assetEtag(File &f, const String &path) {
+  const size_t sz = f.size(); const time_t lw = f.getLastWrite();
+  for (auto &e : etags) if (e.path == path && e.size == sz && e.lw == lw) return e.tag;
+  uint32_t crc = 0; uint8_t buf[512]; size_t n;
+  while ((n = f.read(buf, sizeof(buf))) > 0) crc = esp_rom_crc32_le(crc, buf, n);
+  f.seek(0);
+  EtagEntry &e = etags[etagNext++ % (sizeof(etags) / sizeof(etags[0]))];
+  e.path = path; e.size = sz; e.lw = lw;
+  snprintf(e.tag, sizeof(e.tag), "\"%08x\"", (unsigned)crc);
+  return e.tag;
+}
+
+static const char* assetMime(const String &p) {
+  if (p.endsWith(".html") || p.endsWith(".htm")) return "text/html";
+  if (p.endsWith(".js"))   return "application/javascript";
+  if (p.endsWith(".css"))  return "text/css";
+  if (p.endsWith(".svg"))  return "image/svg+xml";
+  if (p.endsWith(".json")) return "application/json";
+  if (p.endsWith(".ico"))  return "image/x-icon";
+  return "application/octet-stream";
+}
+
+// false nếu không có file (cả bản thường lẫn .gz)
+static bool sendAsset(AsyncWebServerRequest* req, const String &path) {
+  const String gz = path + ".gz";
+  const bool hasGz = LittleFS.exists(gz), hasRaw = LittleFS.exists(path);
+  if (!hasGz && !hasRaw) return false;
+  const bool acceptGz = !req->hasHeader("Accept-Encoding") || req->header("Accept-Encoding").indexOf("gzip") >= 0;
+  const String &src = (hasGz && (acceptGz || !hasRaw)) ? gz : path;
+  File f = LittleFS.open(src, "r");
+  if (!f || f.isDirectory()) return false;
+  const char* tag = assetEtag(f, src);
+  AsyncWebServerResponse* r;
+  if (req->hasHeader("If-None-Match") && req->header("If-None-Match") == tag) {
+    f.close();
+    r = req->beginResponse(304);
+  } else {
+    r = req->beginResponse(f, path, assetMime(path));   // tên file .gz -> tự thêm Content-Encoding: gzip
+  }
+  r->addHeader("ETag", tag);
+  r->addHeader("Cache-Control", "no-cache");
+  if (hasGz && hasRaw) r->addHeader("Vary", "Accept-Encoding");
+  req->send(r);
+  return true;
+}
+
+// ===================== Embedded UI (flash) =====================
+// index.html nén được nhúng vào firmware (ui_embed.h): trang chủ không phụ thuộc LittleFS.
+// Máy không có RTC nên không so mtime được; quyết định theo nội dung (CRC32 = ETag):
+//  - bản FS trùng bản nhúng -> dùng bản nhúng;
+//  - /ui.state nhớ ETag firmware lần trước + ETag bản FS lúc firmware đó được nạp. Firmware mới
+//    (ETag nhúng đổi) -> bản FS đang có là cũ, ghi lại ETag của nó và bỏ qua cho tới khi nó đổi;
+//  - bản FS đổi sau đó (/api/upload, uploadfs) -> FS thắng.
+// Quyết định lúc mở portal và sau mỗi /api/upload (WEB::fsChanged) nên GET / không phải chạm tới FS.
+static bool uiFromFs = false;
+static const char UI_STATE[] = "/ui.state";
+struct UiState { char fw[12]; char stale[12]; };
+
+static bool fsUiTag(char (&tag)[12]) {
+  tag[0] = 0;
+  for (const char* p : {"/index.html.gz", "/index.html"}) {
+    if (!LittleFS.exists(p)) continue;
+    File f = LittleFS.open(p, "r");
+    if (!f) continue;
+    strlcpy(tag, assetEtag(f, p), sizeof(tag));
+    f.close();
+    return true;
+  }
+  return false;
+}
+
+static void pickUiSource() {
+  char fs[12];
+  const bool any = fsUiTag(fs);
+#if UI_EMBED
+  UiState st{};
+  File m = LittleFS.open(UI_STATE, "r");
+  const bool have = m && m.read((uint8_t*)&st, sizeof(st)) == sizeof(st);
+  if (m) m.close();
+  st.fw[sizeof(st.fw) - 1] = st.stale[sizeof(st.stale) - 1] = 0;
+  if (!have || strcmp(st.fw, UI_EMBED_ETAG) != 0) {
+    // chưa có marker (FS vừa format/nạp lại): bản FS (nếu có) được coi là chủ ý -> không đánh dấu cũ
+    strlcpy(st.stale, have ? fs : "", sizeof(st.stale));
+    strlcpy(st.fw, UI_EMBED_ETAG, sizeof(st.fw));
+    File w = LittleFS.open(UI_STATE, "w");
+    if (w) { w.write((const uint8_t*)&st, sizeof(st)); w.close(); }
+  }
+  uiFromFs = any && strcmp(fs, UI_EMBED_ETAG) != 0 && strcmp(fs, st.stale) != 0;
+  SLOGf("[WEB] UI: %s (fs=%s stale=%s embed=%s)\n", uiFromFs ? "LittleFS" : "flash",
+        any ? fs : "-", st.stale[0] ? st.stale : "-", UI_EMBED_ETAG);
+#else
+  uiFromFs = any;
+#endif
+}
+
+void WEB::fsChanged() {
+  // không có RTC: lastWrite có thể trùng giữa hai lần ghi -> bỏ cache ETag cho chắc
+  for (auto &e : etags) e.path = "";
+  pickUiSource();
+}
+
+#if UI_EMBED
+// Trả thẳng từ flash: AsyncProgmemResponse đọc dần theo cửa sổ TCP, không chép vào heap.
+static void sendEmbedded(AsyncWebServerRequest* req) {
+  AsyncWebServerResponse* r;
+  if (req->hasHeader("If-None-Match") && req->header("If-None-Match") == UI_EMBED_ETAG) {
+    r = req->beginResponse(304);
+  } else {
+    r = req->beginResponse(200, "text/html", UI_EMBED_GZ, UI_EMBED_GZ_LEN);
+    r->addHeader("Content-Encoding", "gzip");
+  }
+  r->addHeader("ETag", UI_EMBED_ETAG);
+  r->addHeader("Cache-Control", "no-cache");
+  req->send(r);
+}
+#endif
+
+// ===================== Log stream =====================
+// Mỗi bản ghi một đơn vị; con trỏ r chụp head lúc mở nên response không dài thêm khi log chạy.
+// wrap: dạng {"seq","reset","items":[...]} của ?since=, không thì mảng trần như cũ.
+static void sendLog(AsyncWebServerRequest* req, LOGR::Reader r, bool wrap) {
+  JSONS::send(req, [r, wrap](JSONS::Writer &w, uint32_t step) mutable {
+    if (!step) {
+      if (wrap) { w.obj(); w.kv("seq", r.h); w.kv("reset", r.reset); w.arr("items"); }
+      else w.arr();
+    }
+    uint32_t s; LogItem it;
+    if (!LOGR::next(r, s, it)) { w.end(); if (wrap) w.end(); return false; }
+    char buf[160]; LOGR::itemToJson(buf, sizeof(buf), s, it);
+    w.raw(buf);
+    return true;
+  });
+}
+
+// ===================== Telemetry push (SSE /api/events) =====================
+// Một kênh đẩy thay cho poll /api/rpm, /api/log, /api/apinfo. Sự kiện:
+//   rpm   : tele_hz lần/giây   {"rpm","drpm","gear","inj_us","load"}
+//   state : 1 lần/giây         {"locked","profile","ssid","ip","clients","drops"}
+//   log   : khi có bản ghi mới, như /api/log?since= (mỗi client một con trỏ seq)
+// Backpressure theo client: còn >= EV_BACKLOG gói chưa gửi -> bỏ khung rpm/state của client đó
+// (khung sau thay thế), log giữ nguyên con trỏ nên không mất bản ghi.
+static AsyncEventSource events("/api/events");
+static constexpr uint8_t EV_MAX     = 4;
+static constexpr size_t  EV_BACKLOG = 4;
+struct EvClient { AsyncEventSourceClient *c; uint32_t logSeq; };
+static EvClient evc[EV_MAX];
+static uint8_t  evCount = 0;
+static uint32_t evDrops = 0;
+static uint32_t evNext = 0, evStateNext = 0;
+static SemaphoreHandle_t evLock = nullptr;   // onDisconnect (async_tcp) vs evTick (loop): client không bị xóa khi đang gửi
+
+// SSID/IP của AP vào mảng cố định (không qua String của WiFi.softAPSSID()/toString()).
+struct ApInfo { char ssid[33]; char ip[16]; };
+static void apInfo(ApInfo &ap) {
+  wifi_config_t wc{}; esp_wifi_get_config(WIFI_IF_AP, &wc);
+  strlcpy(ap.ssid, (const char*)wc.ap.ssid, sizeof(ap.ssid));
+  const IPAddress a = WiFi.softAPIP();
+  snprintf(ap.ip, sizeof(ap.ip), "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+}
+
+// Trường rpm dùng chung cho sự kiện rpm, /api/rpm và /api/status.
+// RPM::get() đã gồm ppr và rpm_scale (rpm_k) -> không nhân scale lần nữa.
+static void rpmFields(JSONS::Writer &w) {
+  w.kv("rpm", RPM::get()); w.kv("drpm", (int)RPMTRK::drpm()); w.kv("gear", GEAR::current());
+  w.kv("inj_us", RPM::injWidthUs()); w.kv("load", RPM::injDuty());
+}
+
+// ===================== /api/status (cache) =====================
+// Một thân JSON gộp rpm + khóa + AP + profile + con trỏ log cho mọi client poll.
+// Dựng lại khi cũ hơn 1000/tele_hz ms (TTL tính lại khi gen đổi) hoặc thế hệ đổi (gen cấu hình, khóa, seq log);
+// còn lại mỗi request chỉ chép buffer. Handler HTTP chạy tuần tự trong task async_tcp nên không cần khóa.
+struct StatusKey { uint32_t gen, logSeq; bool locked; };
+static char      stBody[320];
+static StatusKey stKey{};
+static uint32_t  stAt = 0;
+static bool      stValid = false;
+static uint32_t  stBuilds = 0, stHits = 0;
+static uint32_t  stTtl = 50;
+
+static const char* statusBody() {
+  const uint32_t now = millis();
+  const StatusKey k{CFG::gen(), LOGR::seq(), LOCK::isLocked()};
+  if (stValid && now - stAt < stTtl && k.gen == stKey.gen && k.logSeq == stKey.logSeq && k.locked == stKey.locked) {
+    stHits++;
+    return stBody;
+  }
+  ApInfo ap; apInfo(ap);
+
+  // tele_hz chỉ đổi theo gen: chép cấu hình khi gen mới, không phải mỗi dòng log
+  if (!stValid || k.gen != stKey.gen) stTtl = 1000 / constrain(CFG::snapshot().tele_hz, (uint8_t)1, (uint8_t)50);
+
+  JSONS::Writer w; w.reset(stBody, sizeof(stBody));
+  w.obj();
+  w.kv("gen", k.gen);
+  rpmFields(w);
+  w.kv("locked", k.locked); w.kv("profile", CFG::profile());
+  w.kv("ssid", ap.ssid); w.kv("ip", ap.ip);
+  w.kv("clients", evCount); w.kv("log_seq", k.logSeq);
+  w.end();
+  w.c_str();
+  stKey = k; stAt = now; stValid = true; stBuilds++;
+  return stBody;
+}
+
 // ===================== FS debug – danh sách file =====================
 static void listFS() {
   SLOGln("[FS] Listing LittleFS:");
@@ -43,7 +282,7 @@ static void listFS() {
         (unsigned)LittleFS.totalBytes(), (unsigned)LittleFS.usedBytes());
 }
 // Helper: lấy param từ query trước, nếu không có thì lấy từ POST body
-auto getParam = [&](AsyncWebServerRequest* req, const char* key, const char* def = nullptr) -> String {
+static auto getParam = [](AsyncWebServerRequest* req, const char* key, const char* def = nullptr) -> String {
   if (req->hasParam(key))                    return req->getParam(key)->value();         // query string
   if (req->hasParam(key, true))              return req->getParam(key, true)->value();   // POST body
   return def ? String(def) : String();
@@ -54,18 +293,21 @@ static void handleAPI() {
   // --------- Config get/set ----------
   server.on("/api/get", HTTP_GET, [](AsyncWebServerRequest* req) {
     SLOGln("[API] GET /api/get");
-    String js; CFG::exportJSON(js);
-    req->send(200, "application/json", js);
+    // bản chụp nằm trong closure tới hết response (công bố mới giữa chừng không làm lệch JSON)
+    const QSConfig c = CFG::snapshot(); const uint8_t prof = CFG::profile();
+    JSONS::send(req, [c, prof](JSONS::Writer &w, uint32_t step){ return CFG::exportJSON(w, c, prof, step); });
     lastHit = millis();
   });
   // --------- Wi-Fi get/set (AP SSID/Password) ----------
   server.on("/api/wifi_get", HTTP_GET, [](AsyncWebServerRequest* req){
-    DynamicJsonDocument d(256);
-    const auto& c = CFG::get();
-    d["ap_ssid"] = String(c.ap_ssid);
-    d["ap_pass_len"] = (uint8_t)strlen(c.ap_pass);
-    String out; serializeJson(d, out);
-    req->send(200, "application/json", out);
+    const QSConfig c = CFG::snapshot();
+    struct Snap { char ssid[sizeof(c.ap_ssid)]; uint8_t pass_len; } sn;
+    memcpy(sn.ssid, c.ap_ssid, sizeof(sn.ssid)); sn.ssid[sizeof(sn.ssid) - 1] = '\0';
+    sn.pass_len = (uint8_t)strlen(c.ap_pass);
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t){
+      w.obj(); w.kv("ap_ssid", sn.ssid); w.kv("ap_pass_len", (unsigned)sn.pass_len); w.end();
+      return false;
+    });
   });
 
   server.on("/api/wifi_set", HTTP_POST, [](AsyncWebServerRequest* req){}, nullptr,
@@ -76,7 +318,7 @@ static void handleAPI() {
       String ssid = d["ap_ssid"] | "";
       String pass = d["ap_pass"] | "";
       if (pass.length() && pass.length() < 8) { req->send(400, "text/plain", "pass>=8"); return; }
-      auto c = CFG::get();
+      auto c = CFG::snapshot();
       if (ssid.length()) ssid.toCharArray(c.ap_ssid, sizeof(c.ap_ssid));
       if (pass.length()) pass.toCharArray(c.ap_pass, sizeof(c.ap_pass));
       CFG::set(c);
@@ -88,6 +330,7 @@ static void handleAPI() {
   server.on("/api/reboot", HTTP_POST, [](AsyncWebServerRequest* req){
     req->send(200, "text/plain", "REBOOT");
     req->client()->close(true);
+    CFG::flush();                   // cấu hình còn chờ ghi
     delay(400);
     ESP.restart();
   });
@@ -98,33 +341,36 @@ static void handleAPI() {
   }, NULL, [](AsyncWebServerRequest* req, uint8_t* data, size_t len, size_t, size_t) {
     String body((char*)data, len);
     bool ok = CFG::importJSON(body);
-    if (ok) { extern void BACKFIRE_applyConfigFromCFG(); BACKFIRE_applyConfigFromCFG(); }
     SLOGf("[API] /api/set → %s\n", ok ? "OK" : "BAD");
     lastHit = millis();
 
     // Echo back a compact summary so UI can verify what is applied
-    const auto& c = CFG::get();
-    String out = "{";
-    out += "\"ok\":"; out += ok?"true":"false"; out += ",";
-    out += "\"applied\":{";
-    out += "\"bf_enable\":" + String((int)c.bf_enable) + ",";
-    out += "\"bf_mode\":"   + String((int)c.bf_mode)   + ",";
-    out += "\"bf_ign_only\":"+ String((int)c.bf_ign_only) + ",";
-    out += "\"bf_rpm_min\":" + String((int)c.bf_rpm_min) + ",";
-    out += "\"bf_rpm_max\":" + String((int)c.bf_rpm_max) + ",";
-    out += "\"cut_output\":" + String((int)c.cut_output) + ",";
-    out += "\"mode\":"       + String((int)c.mode)       + ",";
-    out += "\"map_count\":"  + String((int)c.map_count);
-    out += "}}";
-    req->send(ok?200:400, "application/json", out);
+    CFG::Snapshot sn; CFG::snapshot(sn);
+    JSONS::send(req, ok ? 200 : 400, [ok, sn](JSONS::Writer &w, uint32_t){
+      const QSConfig &c = sn.cfg;
+      w.obj(); w.kv("ok", ok);
+      w.obj("applied");
+      w.kv("bf_enable", (int)c.bf_enable); w.kv("bf_mode", (int)c.bf_mode); w.kv("bf_ign_only", (int)c.bf_ign_only);
+      w.kv("bf_rpm_min", (int)c.bf_rpm_min); w.kv("bf_rpm_max", (int)c.bf_rpm_max);
+      w.kv("cut_output", (int)c.cut_output); w.kv("mode", (int)c.mode);
+      w.kv("map_count", (int)c.map_count); w.kv("map_status", (int)sn.map_status); w.kv("gen", sn.gen);
+      w.end(); w.end();
+      return false;
+    });
   });
 
   // --------- Logs ----------
+  // /api/log?since=N: chỉ bản ghi có seq >= N; không có gì mới -> 204 không thân
   server.on("/api/log", HTTP_GET, [](AsyncWebServerRequest* req) {
-    SLOGln("[API] GET /api/log");
-    String js; LOGR::readAllToJson(js);
-    req->send(200, "application/json", js);
     lastHit = millis();
+    if (req->hasParam("since")) {
+      const uint32_t since = (uint32_t)strtoul(req->getParam("since")->value().c_str(), nullptr, 10);
+      if (since == LOGR::seq()) { req->send(204); return; }
+      sendLog(req, LOGR::openSince(since), true);
+      return;
+    }
+    SLOGln("[API] GET /api/log");
+    sendLog(req, LOGR::openAll(), false);
   });
 
   server.on("/api/clearlog", HTTP_POST, [](AsyncWebServerRequest* req) {
@@ -134,13 +380,159 @@ static void handleAPI() {
     lastHit = millis();
   });
 
+  // --------- Cut pulse jitter (requested vs actual, µs) ----------
+  server.on("/api/cutstat", HTTP_GET, [](AsyncWebServerRequest* req) {
+    struct Snap { CUT::PulseStats s; CUT::QueueStats q[2]; uint8_t holders[2]; CUT::ArbStats as[CUT::OWNERS]; uint32_t act[CUT::OWNERS]; } sn;
+    sn.s = CUT::pulseStats();
+    for (uint8_t i=0;i<2;i++){
+      const CutLine l = i==0 ? CutLine::IGN : CutLine::INJ;
+      sn.q[i] = CUT::queueStats(l); sn.holders[i] = CUT::holders(l);
+    }
+    for (uint8_t i=0;i<CUT::OWNERS;i++){ sn.as[i] = CUT::arbStats((CutOwner)i); sn.act[i] = CUT::lastActUs((CutOwner)i); }
+    if (req->hasParam("reset")) CUT::resetPulseStats();
+    // đơn vị: tổng quát | từng line | bảng tranh chấp
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t step){
+      if (step == 0) {
+        w.obj();
+        w.kv("count", sn.s.count); w.kv("req_us", sn.s.last_req_us); w.kv("act_us", sn.s.last_act_us);
+        w.kv("min_err", (int)sn.s.min_err_us); w.kv("max_err", (int)sn.s.max_err_us);
+        // hàng đợi đoạn cắt theo line: depth, max depth, xong, overrun, trễ
+        w.arr("q");
+        return true;
+      }
+      if (step <= 2) {
+        const uint8_t i = step - 1;
+        const CUT::QueueStats &q = sn.q[i];
+        w.obj();
+        w.kv("line", i==0 ? "IGN" : "INJ"); w.kv("depth", (unsigned)q.depth);
+        w.kv("max_depth", (unsigned)q.max_depth); w.kv("segs", (unsigned)q.segs);
+        w.kv("overruns", (unsigned)q.overruns); w.kv("late", (unsigned)q.late);
+        w.kv("max_late_us", (unsigned)q.max_late_us);
+        w.kv("spark_fallback", (unsigned)q.spark_fallback);
+        w.kv("prog_steps", (unsigned)q.prog_steps); w.kv("prog_cut", (unsigned)q.prog_cut);
+        w.kv("prog_virt", (unsigned)q.prog_virt);
+        w.kv("holders", (unsigned)sn.holders[i]);
+        w.end();
+        return true;
+      }
+      // tranh chấp theo chủ (thứ tự ưu tiên tăng dần)
+      static const char* const OWN[CUT::OWNERS] = {"test", "bf", "qs", "lock"};
+      w.end();
+      w.obj("arb");
+      for (uint8_t i=0;i<CUT::OWNERS;i++){
+        w.obj(OWN[i]);
+        w.kv("granted", (unsigned)sn.as[i].granted); w.kv("denied", (unsigned)sn.as[i].denied);
+        w.kv("preempted", (unsigned)sn.as[i].preempted); w.kv("act_us", sn.act[i]);
+        w.end();
+      }
+      w.end(); w.end();
+      return false;
+    });
+    lastHit = millis();
+  });
+
+  // --------- Gear estimator: tỉ lệ RPM sau/trước sang số đã học (Q12) ----------
+  server.on("/api/gear", HTTP_GET, [](AsyncWebServerRequest* req) {
+    if (req->hasParam("reset")) CTASK::post(CTASK::Cmd::GEAR_RESET);
+    struct Snap { uint8_t gear; uint16_t last; uint16_t ratio[GEAR::PAIRS]; uint16_t n[GEAR::PAIRS]; } sn;
+    sn.gear = GEAR::current(); sn.last = GEAR::lastRatioQ12();
+    for (uint8_t k=1;k<=GEAR::PAIRS;k++){ sn.ratio[k-1] = GEAR::ratioQ12(k); sn.n[k-1] = GEAR::samples(k); }
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t){
+      w.obj(); w.kv("gear", (unsigned)sn.gear); w.kv("last", (unsigned)sn.last);
+      w.arr("ratio"); for (uint16_t r : sn.ratio) w.val((unsigned)r); w.end();
+      w.arr("n");     for (uint16_t n : sn.n) w.val((unsigned)n); w.end();
+      w.end();
+      return false;
+    });
+    lastHit = millis();
+  });
+
+  // --------- Auto-tune: kết quả lần chỉnh gần nhất + thời gian ổn định từng dải ----------
+  server.on("/api/atune", HTTP_GET, [](AsyncWebServerRequest* req) {
+    struct Snap { ATUNE::Result r; uint8_t en; uint16_t settle[7], n[7]; } sn;
+    sn.r = ATUNE::last(); sn.en = CFG::snapshot().at_enable;
+    for (uint8_t i=0;i<7;i++){ sn.settle[i] = ATUNE::bandSettle(i); sn.n[i] = ATUNE::bandCount(i); }
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t){
+      w.obj(); w.kv("en", (unsigned)sn.en);
+      w.obj("last");
+      w.kv("band", (unsigned)sn.r.band); w.kv("cut", (unsigned)sn.r.cut_ms);
+      w.kv("settle", (unsigned)sn.r.settle_ms); w.kv("new", (unsigned)sn.r.new_ms);
+      w.kv("v", (unsigned)sn.r.verdict);
+      w.end();
+      w.arr("bands");
+      for (uint8_t i=0;i<7;i++){ w.obj(); w.kv("s", (unsigned)sn.settle[i]); w.kv("n", (unsigned)sn.n[i]); w.end(); }
+      w.end(); w.end();
+      return false;
+    });
+    lastHit = millis();
+  });
+
+  // --------- Task điều khiển 1 kHz: jitter/thời gian chạy/hàng lệnh ----------
+  server.on("/api/task", HTTP_GET, [](AsyncWebServerRequest* req) {
+    struct Snap { CTASK::Stats t; CFG::SaveStats sv; uint32_t builds, hits, ovf; } sn{CTASK::stats(), CFG::saveStats(), stBuilds, stHits, JSONS::overflows()};
+    if (req->hasParam("reset")) CTASK::resetStats();
+    // đơn vị: task điều khiển | lưu cấu hình + web
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t step){
+      if (step == 0) {
+        const CTASK::Stats &t = sn.t;
+        w.obj();
+        w.kv("period_us", (unsigned)CTASK::PERIOD_US); w.kv("loops", (unsigned)t.loops);
+        w.kv("max_jitter_us", (unsigned)t.max_jitter_us); w.kv("late", (unsigned)t.late);
+        w.kv("overruns", (unsigned)t.overruns); w.kv("max_exec_us", (unsigned)t.max_exec_us);
+        w.kv("avg_exec_us", (unsigned)t.avg_exec_us); w.kv("cmds", (unsigned)t.cmds);
+        w.kv("drops", (unsigned)t.drops); w.kv("stack_free", (unsigned)t.stack_free);
+        return true;
+      }
+      w.kv("cfg_writes", (unsigned)sn.sv.writes); w.kv("cfg_coalesced", (unsigned)sn.sv.coalesced);
+      w.kv("cfg_errors", (unsigned)sn.sv.errors); w.kv("cfg_last_ms", (unsigned)sn.sv.last_ms);
+      w.kv("cfg_pending", (bool)sn.sv.pending);
+      w.kv("status_builds", sn.builds); w.kv("status_hits", sn.hits);
+      w.kv("json_overflows", sn.ovf);
+      w.end();
+      return false;
+    });
+    lastHit = millis();
+  });
+
+  // --------- Profiles ----------
+  // GET: profile đang chọn + tên; POST: sel=i (đổi ngay, không ghi flash) | name=... (đổi tên profile đang chọn) | copy=i
+  auto profileJson = [](AsyncWebServerRequest* req){
+    struct Snap { uint8_t active; char names[CFG::PROFILES][CFG::PROFILE_NAME_LEN + 1]; } sn;
+    sn.active = CFG::profile();
+    for (uint8_t i=0;i<CFG::PROFILES;i++) strlcpy(sn.names[i], CFG::profileName(i), sizeof(sn.names[i]));
+    JSONS::send(req, [sn](JSONS::Writer &w, uint32_t){
+      w.obj(); w.kv("active", (unsigned)sn.active);
+      w.arr("names"); for (const auto &n : sn.names) w.val(n); w.end();
+      w.end();
+      return false;
+    });
+  };
+  server.on("/api/profile", HTTP_GET, [profileJson](AsyncWebServerRequest* req) {
+    profileJson(req);
+    lastHit = millis();
+  });
+  server.on("/api/profile", HTTP_POST, [profileJson](AsyncWebServerRequest* req) {
+    String v = getParam(req, "sel");
+    if (v.length()) CFG::selectProfile((uint8_t)v.toInt());
+    v = getParam(req, "copy");
+    if (v.length()) CFG::copyProfile((uint8_t)v.toInt());
+    v = getParam(req, "name");
+    if (v.length()) {
+      // chỉ giữ ký tự an toàn cho JSON / HTML
+      String n;
+      for (size_t i=0;i<v.length();i++){ const char ch = v[i]; if (isalnum((unsigned char)ch) || ch == '-' || ch == '_' || ch == ' ') n += ch; }
+      if (n.length()) CFG::setProfileName(CFG::profile(), n.c_str());
+    }
+    profileJson(req);
+    lastHit = millis();
+  });
+
   // --------- Test output (cut 50ms) ----------
   server.on("/api/testcut", HTTP_POST, [](AsyncWebServerRequest* req) {
   String out = getParam(req, "out");
   SLOGf("[API] POST /api/testcut out=%s\n", out.c_str());
   if (out != "ign" && out != "inj") { req->send(400, "text/plain", "out? ign|inj"); return; }
-  extern void CUT_testPulse(bool useIgn, uint16_t ms);
-  CUT_testPulse(out == "ign", 50);
+  CTASK::post(CTASK::Msg{CTASK::Cmd::TEST_CUT, (uint8_t)(out == "ign"), 50, 0, 0});
   req->send(200, "text/plain", "OK");
   lastHit = millis();
 });
@@ -153,8 +545,7 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
   float rpm = getParam(req, "rpm", "0").toFloat();
   float ppr = getParam(req, "ppr", "1").toFloat();
   SLOGf("[API] POST /api/testrpm en=%d rpm=%.1f ppr=%.2f\n", en, rpm, ppr);
-  PWMTEST::enable(en != 0);
-  PWMTEST::setSim(rpm, ppr <= 0 ? 1 : ppr);
+  CTASK::post(CTASK::Msg{CTASK::Cmd::PWM_TEST, (uint8_t)(en != 0), 0, rpm, ppr <= 0 ? 1 : ppr});
   req->send(200, "text/plain", "OK test r");
   lastHit = millis();
 });
@@ -162,15 +553,19 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
   // --------- Calibrate RPM ----------
   // /api/calib?true_rpm=XXXX
   server.on("/api/calib", HTTP_POST, [](AsyncWebServerRequest* req) {
-    auto p = req->getParam("true_rpm", true);
-    SLOGf("[API] POST /api/calib true_rpm=%s\n", p ? p->value().c_str() : "?");
-    if (!p) { req->send(400, "text/plain", "true_rpm?"); return; }
-    uint16_t true_rpm = p->value().toInt();
+    const String v = getParam(req, "true_rpm");   // UI gửi qua query string
+    SLOGf("[API] POST /api/calib true_rpm=%s\n", v.length() ? v.c_str() : "?");
+    uint16_t true_rpm = v.toInt();
+    if (!true_rpm) { req->send(400, "text/plain", "true_rpm?"); return; }
+    // chụp trước khi đo: scale này là scale đã nằm trong số đo
+    auto cfg = CFG::snapshot();
     uint32_t t0 = millis(), n = 0, sum = 0;
     while (millis() - t0 < 1000) { extern uint16_t RPM_get(); sum += RPM_get(); n++; delay(5); }
-    float meas = (n ? (float)sum / n : 1.0f);
-    auto cfg = CFG::get();
-    cfg.rpm_scale = (meas > 0 ? (float)true_rpm / meas : 1.0f);
+    float meas = (n ? (float)sum / n : 0.0f);
+    // RPM::get() đã nhân rpm_scale -> scale mới = scale cũ * đúng / đo (không thì hiệu chỉnh lần 2 sai)
+    const float cur = cfg.rpm_scale > 0 ? cfg.rpm_scale : 1.0f;
+    if (meas <= 0) { req->send(409, "text/plain", "no rpm signal"); return; }
+    cfg.rpm_scale = cur * (float)true_rpm / meas;
     CFG::set(cfg);
     req->send(200, "text/plain", "OK");
     lastHit = millis();
@@ -188,11 +583,11 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
 
   // --------- AP info (SSID, IP) ----------
   server.on("/api/apinfo", HTTP_GET, [](AsyncWebServerRequest* req){
-    String js = "{";
-    js += "\"ssid\":\"" + WiFi.softAPSSID() + "\",";
-    js += "\"ip\":\"" + WiFi.softAPIP().toString() + "\"";
-    js += "}";
-    req->send(200, "application/json", js);
+    ApInfo ap; apInfo(ap);
+    JSONS::send(req, [ap](JSONS::Writer &w, uint32_t){
+      w.obj(); w.kv("ssid", ap.ssid); w.kv("ip", ap.ip); w.end();
+      return false;
+    });
     lastHit = millis();
   });
 
@@ -213,7 +608,7 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
       String oldp = d["old"] | "";
       String neo  = d["neo"] | "";
       if (neo.length()==0 || neo.length()>8) { req->send(400, "text/plain", "len 1..8"); return; }
-      auto c = CFG::get();
+      auto c = CFG::snapshot();
       if (oldp != String(c.lock_code)) { req->send(403, "text/plain", "BAD OLD"); return; }
       neo.toCharArray(c.lock_code, sizeof(c.lock_code));
       CFG::set(c);
@@ -223,27 +618,29 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
   );
 
   // --------- FS LIST (JSON) ----------
+  // mỗi file một đơn vị: thư mục mở trong closure, duyệt dần theo nhịp TCP
   server.on("/api/fslist", HTTP_GET, [](AsyncWebServerRequest* req){
-    String js = "[";
     File root = LittleFS.open("/");
     if (!root) { req->send(500, "application/json", "[]"); return; }
-    File f = root.openNextFile();
-    bool first = true;
-    while (f) {
-      if (!first) js += ",";
-      first = false;
-      js += "{\"name\":\"" + String(f.name()) + "\",\"size\":" + String((unsigned)f.size()) + "}";
-      f = root.openNextFile();
-    }
-    js += "]";
-    req->send(200, "application/json", js);
+    JSONS::send(req, [root](JSONS::Writer &w, uint32_t step) mutable {
+      if (!step) w.arr();
+      File f = root.openNextFile();
+      if (!f) { w.end(); return false; }
+      w.obj(); w.kv("name", f.name()); w.kv("size", (unsigned)f.size()); w.end();
+      return true;
+    });
     lastHit = millis();
   });
 
-  // --------- Root UI (LittleFS + fallback) ----------
+  // --------- Root UI (flash / LittleFS + fallback) ----------
   server.on("/", HTTP_GET, [](AsyncWebServerRequest* req){
     SLOGf("[WEB] GET / from %s\n", req->client()->remoteIP().toString().c_str());
-    if (!LittleFS.exists("/index.html")) {
+    lastHit = millis(); holdPortal = true;
+    if (uiFromFs && sendAsset(req, "/index.html")) return;
+#if UI_EMBED
+    sendEmbedded(req);
+#else
+    {
       const char* fb =
         "<!doctype html><meta charset=utf-8>"
         "<style>body{font-family:system-ui;padding:16px;line-height:1.45}" \
@@ -275,43 +672,40 @@ server.on("/api/testrpm", HTTP_POST, [](AsyncWebServerRequest* req) {
           " fetch('/api/ota/restore?what='+what+'&which='+which).then(r=>r.text()).then(t=>alert(t)).catch(()=>{});\n"
         "}</script>";
       req->send(200, "text/html", fb);
-      return;
     }
-    req->send(LittleFS, "/index.html", "text/html");
-    lastHit = millis(); holdPortal = true;
+#endif
   });
 
-  // (Tuỳ chọn) phục vụ thêm file tĩnh khác nếu bạn có (css/js…)
-  server.serveStatic("/", LittleFS, "/");
+  // File tĩnh khác (css/js…): onNotFound gọi sendAsset trước khi chuyển về "/"
 
   // --------- OTA routes ----------
   OTAHTTP_registerRoutes(server);
 
   // /api/rpm  → trả rpm hiện tại (JSON)
 server.on("/api/rpm", HTTP_GET, [](AsyncWebServerRequest* req){
-  extern uint16_t RPM_get();          // đã dùng trong /api/calib
-  float rpm_raw = (float)RPM_get();
-  auto cfg = CFG::get();
-  float rpm = rpm_raw * (cfg.rpm_scale > 0 ? cfg.rpm_scale : 1.0f);
-
-  // (tuỳ chọn) clamp để tránh giá trị lố
-  if (rpm < 0) rpm = 0;
-
-  // trả JSON rất nhẹ để poll nhanh
-  String js = String("{\"rpm\":") + String((int)rpm) + "}";
-  req->send(200, "application/json", js);
+  char b[128];
+  JSONS::Writer w; w.reset(b, sizeof(b));
+  w.obj(); rpmFields(w); w.end();
+  req->send(200, "application/json", w.c_str());
+  lastHit = millis();
+});
+// /api/status → rpm + khóa + AP + profile + seq log trong một lần poll (thân dựng sẵn, xem statusBody)
+server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest* req){
+  req->send(200, "application/json", statusBody());
   lastHit = millis();
 });
 // === LOCK API ===
 server.on("/api/lock_state", HTTP_GET, [](AsyncWebServerRequest* req) {
-  const auto c = CFG::get();
-  DynamicJsonDocument doc(256);
-  doc["locked"]        = LOCK::isLocked();
-  doc["lock_enabled"]  = c.lock_enabled;
-  doc["lock_cut_sel"]  = (uint8_t)c.lock_cut_sel;
-  doc["lock_code_len"] = (uint8_t)strlen(c.lock_code);
-  String out; serializeJson(doc, out);
-  req->send(200, "application/json", out);
+  const QSConfig c = CFG::snapshot();
+  struct Snap { bool locked, enabled; uint8_t cut_sel, code_len; } sn{
+    LOCK::isLocked(), c.lock_enabled, (uint8_t)c.lock_cut_sel, (uint8_t)strlen(c.lock_code)};
+  JSONS::send(req, [sn](JSONS::Writer &w, uint32_t){
+    w.obj();
+    w.kv("locked", sn.locked); w.kv("lock_enabled", sn.enabled);
+    w.kv("lock_cut_sel", (unsigned)sn.cut_sel); w.kv("lock_code_len", (unsigned)sn.code_len);
+    w.end();
+    return false;
+  });
   lastHit = millis();
 });
 
@@ -325,11 +719,12 @@ server.on("/api/lock_cmd", HTTP_POST, [](AsyncWebServerRequest* req){
   if (e) { req->send(400, "text/plain", "BAD JSON"); return; }
   String cmd = d["cmd"] | "";
   if (cmd == "lock") {
-    LOCK::forceLock();
+    CTASK::post(CTASK::Cmd::LOCK);
     req->send(200, "text/plain", "OK");
   } else if (cmd == "unlock") {
     String pass = d["pass"] | "";
-    bool ok = LOCK::adminUnlock(pass);   // hàm mới ở lock_guard.*
+    bool ok = LOCK::passOk(pass);        // mở khóa thực hiện trong task điều khiển
+    if (ok) CTASK::post(CTASK::Cmd::UNLOCK);
     req->send(ok?200:403, "text/plain", ok? "OK" : "BAD");
   } else {
     req->send(400, "text/plain", "cmd?");
@@ -340,6 +735,85 @@ server.on("/api/lock_cmd", HTTP_POST, [](AsyncWebServerRequest* req){
 
 }
 
+// ===================== Telemetry push =====================
+static void evRegister() {
+  if (evLock) return;                 // portal mở lại: handler đã gắn
+  evLock = xSemaphoreCreateMutex();
+  events.onConnect([](AsyncEventSourceClient* c){
+    xSemaphoreTake(evLock, portMAX_DELAY);
+    uint8_t i = 0;
+    while (i < EV_MAX && evc[i].c) i++;
+    if (i < EV_MAX) { evc[i] = EvClient{c, 0}; evCount++; }   // logSeq 0: nhận cả vòng log lúc đầu
+    xSemaphoreGive(evLock);
+    if (i >= EV_MAX) { c->close(); return; }
+    c->send("hello", nullptr, 0, 2000);                         // retry 2 s khi mất kết nối
+    lastHit = millis();
+  });
+  events.onDisconnect([](AsyncEventSourceClient* c){
+    xSemaphoreTake(evLock, portMAX_DELAY);
+    for (auto &e : evc) if (e.c == c) { e.c = nullptr; evCount--; }
+    xSemaphoreGive(evLock);
+  });
+  server.addHandler(&events);
+}
+
+// Sự kiện log cho một client vào buf cố định: dồn bản ghi tới khi đầy, phần còn lại đi ở nhịp sau.
+// {"reset","items":[...],"seq"}: seq = con trỏ kế tiếp của client (bản ghi đầu chưa gửi).
+static uint32_t evLogJson(JSONS::Writer &w, size_t cap, uint32_t since) {
+  LOGR::Reader r = LOGR::openSince(since);
+  uint32_t next = r.h, s; LogItem it; char ib[160];
+  w.obj(); w.kv("reset", r.reset); w.arr("items");
+  while (LOGR::next(r, s, it)) {
+    const int n = LOGR::itemToJson(ib, sizeof(ib), s, it);
+    if (w.len() + n + 24 >= cap) { next = s; break; }   // chừa chỗ cho ],"seq":N}
+    w.raw(ib);
+  }
+  w.end(); w.kv("seq", next); w.end();
+  return next;
+}
+
+static void evTick() {
+  if (!evCount) return;
+  const uint32_t now = millis();
+  if ((int32_t)(now - evNext) < 0) return;
+  const uint8_t hz = constrain(loopCfg().tele_hz, (uint8_t)1, (uint8_t)50);
+  evNext = now + 1000 / hz;
+  lastHit = now;                      // UI đang mở: giữ portal
+
+  char rb[128];
+  JSONS::Writer rw; rw.reset(rb, sizeof(rb));
+  rw.obj(); rpmFields(rw); rw.end();
+  const char* rpm = rw.c_str();
+  char sb[160];
+  JSONS::Writer sw; sw.reset(sb, sizeof(sb));
+  const bool state = (int32_t)(now - evStateNext) >= 0;
+  if (state) {
+    evStateNext = now + 1000;
+    ApInfo ap; apInfo(ap);
+    sw.obj(); sw.kv("locked", LOCK::isLocked()); sw.kv("profile", (unsigned)CFG::profile());
+    sw.kv("ssid", ap.ssid); sw.kv("ip", ap.ip);
+    sw.kv("clients", (unsigned)evCount); sw.kv("drops", (unsigned)evDrops);
+    sw.end();
+  }
+  const char* st = sw.c_str();
+  const uint32_t lseq = LOGR::seq();
+  static char lb[1024];               // chỉ loopTask gọi evTick
+
+  xSemaphoreTake(evLock, portMAX_DELAY);
+  for (auto &e : evc) {
+    if (!e.c || !e.c->connected()) continue;
+    if (e.c->packetsWaiting() >= EV_BACKLOG) { evDrops++; continue; }
+    e.c->send(rpm, "rpm");
+    if (state) e.c->send(st, "state");
+    if (e.logSeq != lseq) {
+      JSONS::Writer lw; lw.reset(lb, sizeof(lb));
+      const uint32_t next = evLogJson(lw, sizeof(lb), e.logSeq);
+      if (e.c->send(lw.c_str(), "log")) e.logSeq = next;
+    }
+  }
+  xSemaphoreGive(evLock);
+}
+
 // ===================== Portal lifecycle =====================
 void WEB::beginPortal() {
   if (running) return;
@@ -352,9 +826,10 @@ void WEB::beginPortal() {
     SLOGln("[FS] LittleFS mounted");
     listFS(); // in danh sách file để chắc chắn có /index.html
   }
+  pickUiSource();
 
   WiFi.mode(WIFI_AP);
-  const auto& ccfg = CFG::get();
+  const QSConfig ccfg = CFG::snapshot();
   String ssid = String(ccfg.ap_ssid);
   if (ssid.length() == 0) ssid = String("QS-TuLamDienTu-") + String((uint32_t)ESP.getEfuseMac(), HEX).substring(4);
   String pass = String(ccfg.ap_pass);
@@ -366,16 +841,22 @@ void WEB::beginPortal() {
 
   dns.start(53, "*", WiFi.softAPIP());
   handleAPI();
-  server.onNotFound([](AsyncWebServerRequest* req) { lastHit = millis(); req->redirect("/"); });
+  evRegister();
+  server.onNotFound([](AsyncWebServerRequest* req) {
+    lastHit = millis();
+    if (req->method() == HTTP_GET && sendAsset(req, req->url())) return;
+    req->redirect("/");
+  });
   server.begin();
 }
 
 void WEB::loop() {
   if (!running) return;
   dns.processNextRequest();
+  evTick();
   if (holdPortal) return; // Giữ AP khi người dùng đang mở UI
 
-  uint16_t tout = CFG::get().ap_timeout_s; // timeout cấu hình trong Web
+  uint16_t tout = loopCfg().ap_timeout_s; // timeout cấu hình trong Web
   if (tout > 0 && (millis() - lastHit) > (uint32_t)tout * 1000UL) {
     server.end(); dns.stop(); WiFi.softAPdisconnect(true);
     running = false;
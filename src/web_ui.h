@@ -2,4 +2,5 @@
 namespace WEB {
   void beginPortal(); // starts AP + web, handles auto-timeout per config
   void loop();        // call in loop
+  void fsChanged();   // sau khi ghi file UI lên LittleFS: chọn lại nguồn trang chủ
 }
@@ -0,0 +1,16 @@
+#pragma once
+// Arduino.h tối thiểu cho [env:native]: đủ cho các module thuần tính toán (rpm_track, cut_map, auto_tune).
+// micros()/millis() do từng test tự định nghĩa (đồng hồ giả).
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String;
+uint32_t micros();
+uint32_t millis();
@@ -0,0 +1,201 @@
+// ATUNE trên host: phát lại vết cạnh RPM tổng hợp quanh mỗi lần sang số qua onCut/update
+// (analyze + finish), kiểm tra cut_ms của dải hội tụ về (thời gian ổn định + biên) sau
+// vài lần sang số, và các nhánh từ chối (MISS / SHORT / BLIND) không đụng tới map.
+// Chạy: pio test -e native -f test_auto_tune
+#include <unity.h>
+#include <vector>
+#include "auto_tune.cpp"
+
+// ---------- Giả lập RPM:: (dòng cạnh), CFG:: và đồng hồ ----------
+static constexpr uint32_t PPR = 2;
+static constexpr uint32_t K   = 60000000UL / PPR;
+static std::vector<uint32_t> g_edges;
+static uint32_t g_now = 0;
+static QSConfig g_cfg;
+static uint32_t g_setCalls = 0;
+
+uint32_t micros(){ return g_now; }
+uint32_t millis(){ return g_now / 1000; }
+
+uint32_t RPM::edgeHead(){ return (uint32_t)g_edges.size(); }
+size_t RPM::readEdges(uint32_t &cursor, uint32_t *ts, size_t max){
+  size_t n = 0;
+  while (cursor < g_edges.size() && n < max) ts[n++] = g_edges[cursor++];
+  return n;
+}
+uint16_t RPM::periodToRpm(uint32_t p){
+  if (!p) return 0;
+  const uint32_t r = (K + p/2) / p;
+  return (uint16_t)(r > 20000 ? 20000 : r);
+}
+
+const QSConfig& CFG::get(){ return g_cfg; }
+// Thật: task cfgsave áp vài ms sau; ở đây áp ngay (trước lần sang số kế tiếp là đủ)
+bool CFG::setBandCut(uint8_t band, uint16_t cut_ms){
+  if (band >= 7 || !cut_ms) return false;
+  g_cfg.map[band].cut_ms = cut_ms;
+  g_setCalls++;
+  return true;
+}
+
+// ---------- Mô hình sang số ----------
+// RPM đều r0 tới lúc mở cắt t0, rơi tuyến tính về r1 trong sync_ms (hộp số khớp), rồi đứng ở r1.
+// blind_ms > 0: cắt IGN tắt luôn xung bobin -> không có cạnh trong [t0, t0 + blind_ms).
+// lost_after = true: mất hẳn tín hiệu sau t0.
+struct Shift {
+  uint16_t r0 = 10000, r1 = 7000;
+  uint16_t sync_ms = 48;
+  uint16_t blind_ms = 0;
+  bool     lost_after = false;
+};
+
+static double rpmAt(const Shift &s, double t_us, double t0){
+  if (t_us <= t0) return s.r0;
+  const double k = (t_us - t0) / (s.sync_ms * 1000.0);
+  return k >= 1 ? s.r1 : s.r0 + (s.r1 - (double)s.r0) * k;
+}
+
+// Một lần sang số: 30 ms RPM đều, onCut(cut_ms hiện tại của dải), rồi task 1 kHz: sinh cạnh + update()
+// tới khi ATUNE xong. Trả kết quả ATUNE::last().
+static ATUNE::Result shift(const Shift &s){
+  g_edges.clear();
+  g_now += 100000;                                   // cách lần trước; đồng hồ chỉ tăng
+  double t = g_now;
+  const double t0 = g_now + 30000.0;
+  g_edges.push_back((uint32_t)t);
+  bool cut = false;
+  for (uint32_t ms = 1; ms < 1000; ms++) {
+    g_now += 1000;
+    for (;;) {
+      double p = 60e6 / (PPR * rpmAt(s, t, t0));
+      p = 60e6 / (PPR * rpmAt(s, t + p / 2, t0));
+      if (t + p > g_now) break;
+      t += p;
+      const bool dark = (s.lost_after && t >= t0) || (s.blind_ms && t >= t0 && t < t0 + s.blind_ms * 1000.0);
+      if (!dark) g_edges.push_back((uint32_t)t);
+    }
+    if (!cut && g_now >= t0) {
+      const uint8_t b = findBand(s.r0, g_cfg);
+      ATUNE::onCut(s.r0, g_cfg.map[b].cut_ms);
+      TEST_ASSERT_TRUE(ATUNE::busy());
+      cut = true;
+      continue;
+    }
+    if (cut) {
+      ATUNE::update();
+      if (!ATUNE::busy()) return ATUNE::last();
+    }
+  }
+  TEST_ASSERT_TRUE_MESSAGE(false, "ATUNE không kết thúc");
+  return ATUNE::Result{};
+}
+
+static constexpr uint8_t BAND = 5;                  // 9500..11500 rpm (map mặc định)
+
+void setUp(){ g_cfg = QSConfig(); g_cfg.map_count = 7; g_cfg.at_enable = 1; g_setCalls = 0; }
+void tearDown(){}
+
+// Đo thời gian ổn định: rơi tuyến tính 48 ms, ngưỡng 1/8 quãng rơi -> ~42 ms (+ độ phân giải một chu kỳ ~3-4 ms)
+void test_measures_settle(){
+  const ATUNE::Result r = shift(Shift{});
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::TUNED, r.verdict);
+  TEST_ASSERT_EQUAL_UINT8(BAND, r.band);
+  TEST_ASSERT_UINT_WITHIN(4, 44, r.settle_ms);
+  TEST_ASSERT_EQUAL_UINT16(r.settle_ms, ATUNE::bandSettle(BAND));
+}
+
+// Hội tụ từ dưới (cắt thiếu, +4 ms/lần) và từ trên (cắt thừa, -2 ms/lần) về settle + biên
+static void converge(uint16_t start, uint8_t maxIter){
+  g_cfg.map[BAND].cut_ms = start;
+  const ATUNE::Result first = shift(Shift{});
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::TUNED, first.verdict);
+  const int32_t target = first.settle_ms + g_cfg.at_margin_ms;
+  uint8_t it = 1;
+  while (it < maxIter && abs((int32_t)g_cfg.map[BAND].cut_ms - target) > 1) { shift(Shift{}); it++; }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "start %u -> %u sau %u lần, đích %d", start, g_cfg.map[BAND].cut_ms, it, (int)target);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_INT_WITHIN_MESSAGE(1, target, g_cfg.map[BAND].cut_ms, msg);
+  // đã hội tụ: các lần sau giữ nguyên (không dao động)
+  const uint16_t settled = g_cfg.map[BAND].cut_ms;
+  for (uint8_t k = 0; k < 5; k++) {
+    const ATUNE::Result r = shift(Shift{});
+    TEST_ASSERT_EQUAL_UINT8(ATUNE::TUNED, r.verdict);
+    TEST_ASSERT_EQUAL_UINT16(settled, g_cfg.map[BAND].cut_ms);
+  }
+}
+
+void test_converges_from_below(){ converge(CUT_MS_MIN, 10); }   // 20 -> ~50: 8 bước +4
+void test_converges_from_above(){ converge(80, 18); }           // 80 -> ~50: 15 bước -2
+
+// Kẹp CUT_MS_MAX dù thời gian ổn định dài
+void test_clamped_to_max(){
+  Shift s; s.r1 = 6000; s.sync_ms = 200;
+  g_cfg.map[BAND].cut_ms = CUT_MS_MAX - 2;
+  for (uint8_t k = 0; k < 4; k++) TEST_ASSERT_EQUAL_UINT8(ATUNE::TUNED, shift(s).verdict);
+  TEST_ASSERT_EQUAL_UINT16(CUT_MS_MAX, g_cfg.map[BAND].cut_ms);
+}
+
+// RPM không rơi (nhả chân sang số hụt): MISS, map giữ nguyên
+void test_reject_no_drop(){
+  Shift s; s.r1 = s.r0;
+  const uint16_t before = g_cfg.map[BAND].cut_ms;
+  const ATUNE::Result r = shift(s);
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::MISS, r.verdict);
+  TEST_ASSERT_EQUAL_UINT16(before, r.new_ms);
+  TEST_ASSERT_EQUAL_UINT16(before, g_cfg.map[BAND].cut_ms);
+  TEST_ASSERT_EQUAL(0, g_setCalls);
+}
+
+// Rơi < 3%: coi như không sang số
+void test_reject_small_drop(){
+  Shift s; s.r1 = s.r0 - s.r0 / 40;                  // 2.5%
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::MISS, shift(s).verdict);
+  TEST_ASSERT_EQUAL(0, g_setCalls);
+}
+
+// Mất tín hiệu ngay sau khi cắt: quá ít cạnh -> SHORT (kết thúc nhờ hết giờ)
+void test_reject_signal_lost(){
+  Shift s; s.lost_after = true;
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::SHORT, shift(s).verdict);
+  TEST_ASSERT_EQUAL(0, g_setCalls);
+}
+
+// Cắt IGN dài hơn lúc hộp số khớp: RPM đã ổn định trong khoảng tối -> BLIND, không chỉnh
+void test_reject_blind(){
+  Shift s; s.blind_ms = 60;
+  const uint16_t before = g_cfg.map[BAND].cut_ms;
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::BLIND, shift(s).verdict);
+  TEST_ASSERT_EQUAL_UINT16(before, g_cfg.map[BAND].cut_ms);
+  TEST_ASSERT_EQUAL(0, g_setCalls);
+}
+
+// Khoảng tối ngắn hơn lúc khớp: vẫn đo được
+void test_short_blind_still_tuned(){
+  Shift s; s.blind_ms = 15;
+  const ATUNE::Result r = shift(s);
+  TEST_ASSERT_EQUAL_UINT8(ATUNE::TUNED, r.verdict);
+  TEST_ASSERT_UINT_WITHIN(4, 44, r.settle_ms);
+}
+
+// RPM ngoài mọi dải: không ghi vết
+void test_outside_bands_ignored(){
+  g_cfg.map_count = 2;                              // 3000..5000
+  ATUNE::onCut(10000, 40);
+  TEST_ASSERT_FALSE(ATUNE::busy());
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_measures_settle);
+  RUN_TEST(test_converges_from_below);
+  RUN_TEST(test_converges_from_above);
+  RUN_TEST(test_clamped_to_max);
+  RUN_TEST(test_reject_no_drop);
+  RUN_TEST(test_reject_small_drop);
+  RUN_TEST(test_reject_signal_lost);
+  RUN_TEST(test_reject_blind);
+  RUN_TEST(test_short_blind_still_tuned);
+  RUN_TEST(test_outside_bands_ignored);
+  return UNITY_END();
+}
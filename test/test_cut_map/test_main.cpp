@@ -0,0 +1,188 @@
+// CMAP::lookup2D trên host: nội suy song tuyến (Q16) so với bản tham chiếu số thực,
+// đúng tại nút lưới, kẹp ngoài biên, điểm giữa ô; kèm đo thời gian một lần tra.
+// Chạy: pio test -e native -f test_cut_map
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "cut_map.cpp"
+
+uint32_t micros(){ return 0; }
+uint32_t millis(){ return 0; }
+
+static QSConfig g_cfg;
+static CMAP::Compiled g_m;
+
+static void build(){
+  g_cfg.map2d.enabled = 1;
+  CMAP::compile(g_cfg, g_m);
+  TEST_ASSERT_TRUE(g_m.m2d_on);
+}
+
+// Tham chiếu: song tuyến số thực, kẹp tại biên trục
+static double ref2D(const CutMap2D &m, double x, double y){
+  auto locate = [](const uint16_t *a, uint8_t n, double v, uint8_t &i, double &f){
+    if (n < 2 || v <= a[0]) { i = 0; f = 0; return; }
+    if (v >= a[n-1])        { i = n-1; f = 0; return; }
+    i = 0; while (v >= a[i+1]) i++;
+    f = (v - a[i]) / (double)(a[i+1] - a[i]);
+  };
+  uint8_t i, j; double fx, fy;
+  locate(m.x_rpm, m.nx, x, i, fx);
+  locate(m.y_val, m.ny, y, j, fy);
+  const uint8_t i1 = (i+1 < m.nx) ? i+1 : i, j1 = (j+1 < m.ny) ? j+1 : j;
+  const double a = m.cut_ms[j][i]  + (m.cut_ms[j][i1]  - (double)m.cut_ms[j][i])  * fx;
+  const double b = m.cut_ms[j1][i] + (m.cut_ms[j1][i1] - (double)m.cut_ms[j1][i]) * fx;
+  return a + (b - a) * fy;
+}
+
+void setUp(){ g_cfg = QSConfig(); }
+void tearDown(){}
+
+// Tại nút lưới: đúng giá trị ô, không sai số làm tròn
+void test_exact_at_nodes(){
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  for (uint8_t j=0;j<m.ny;j++)
+    for (uint8_t i=0;i<m.nx;i++)
+      TEST_ASSERT_EQUAL_UINT16(m.cut_ms[j][i], CMAP::lookup2D(g_m, m.x_rpm[i], m.y_val[j]));
+}
+
+// Ngoài lưới: kẹp về hàng/cột biên, kể cả rpm = 0 và 0xFFFF
+void test_clamp_outside(){
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  const uint8_t X = m.nx - 1, Y = m.ny - 1;
+  TEST_ASSERT_EQUAL_UINT16(m.cut_ms[0][0], CMAP::lookup2D(g_m, 0, 0));
+  TEST_ASSERT_EQUAL_UINT16(m.cut_ms[0][0], CMAP::lookup2D(g_m, m.x_rpm[0] - 1, m.y_val[0]));
+  TEST_ASSERT_EQUAL_UINT16(m.cut_ms[Y][X], CMAP::lookup2D(g_m, 0xFFFF, 0xFFFF));
+  TEST_ASSERT_EQUAL_UINT16(m.cut_ms[0][X], CMAP::lookup2D(g_m, 20000, 0));
+  TEST_ASSERT_EQUAL_UINT16(m.cut_ms[Y][0], CMAP::lookup2D(g_m, 100, 99));
+  // một trục kẹp, trục kia vẫn nội suy
+  for (uint8_t j=0;j<m.ny;j++){
+    TEST_ASSERT_EQUAL_UINT16(m.cut_ms[j][X], CMAP::lookup2D(g_m, m.x_rpm[X] + 500, m.y_val[j]));
+    TEST_ASSERT_EQUAL_UINT16(m.cut_ms[j][0], CMAP::lookup2D(g_m, 1000, m.y_val[j]));
+  }
+  const uint16_t xm = (m.x_rpm[2] + m.x_rpm[3]) / 2;
+  TEST_ASSERT_UINT_WITHIN(1, (m.cut_ms[Y][2] + m.cut_ms[Y][3]) / 2, CMAP::lookup2D(g_m, xm, 200));
+}
+
+// Ngay sát biên trong: không nhảy cóc sang ô kế (x[i+1]-1 vẫn thuộc ô i)
+void test_edges_inside(){
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  for (uint8_t i=0;i+1<m.nx;i++){
+    const uint16_t v = CMAP::lookup2D(g_m, m.x_rpm[i+1] - 1, m.y_val[0]);
+    TEST_ASSERT_UINT_WITHIN(1, m.cut_ms[0][i+1], v);
+    TEST_ASSERT_EQUAL_UINT16(m.cut_ms[0][i], CMAP::lookup2D(g_m, m.x_rpm[i], m.y_val[0]));
+  }
+}
+
+// Giữa cạnh và tâm ô: trung bình 2 / 4 nút (±1 do làm tròn Q16)
+void test_midpoints(){
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  for (uint8_t j=0;j+1<m.ny;j++)
+    for (uint8_t i=0;i+1<m.nx;i++){
+      const uint16_t xm = (m.x_rpm[i] + m.x_rpm[i+1]) / 2;
+      TEST_ASSERT_UINT_WITHIN(1, (m.cut_ms[j][i] + m.cut_ms[j][i+1]) / 2, CMAP::lookup2D(g_m, xm, m.y_val[j]));
+    }
+  // trục số (1..5) không có tâm ô nguyên -> tâm ô kiểm trên trục tải (‰)
+  g_cfg = QSConfig();
+  CutMap2D &l = g_cfg.map2d;
+  l.y_src = MapYSrc::LOAD; l.ny = 4;
+  const uint16_t ly[4] = {100, 300, 600, 1000};
+  memcpy(l.y_val, ly, sizeof(ly));
+  build();
+  for (uint8_t j=0;j+1<l.ny;j++)
+    for (uint8_t i=0;i+1<l.nx;i++){
+      const uint16_t xm = (l.x_rpm[i] + l.x_rpm[i+1]) / 2, ym = (l.y_val[j] + l.y_val[j+1]) / 2;
+      const uint32_t avg = (uint32_t)l.cut_ms[j][i] + l.cut_ms[j][i+1] + l.cut_ms[j+1][i] + l.cut_ms[j+1][i+1];
+      TEST_ASSERT_UINT_WITHIN(1, avg / 4, CMAP::lookup2D(g_m, xm, ym));
+    }
+}
+
+// Quét dày cả lưới (kể cả ngoài biên): sai khác so với số thực <= 1 ms (hai lần làm tròn)
+void test_matches_reference(){
+  g_cfg.map2d.y_src = MapYSrc::LOAD; g_cfg.map2d.ny = 6;
+  const uint16_t ly[6] = {0, 150, 300, 500, 750, 1000};
+  memcpy(g_cfg.map2d.y_val, ly, sizeof(ly));
+  // hàng có dốc ngược để thử phần chênh âm
+  for (uint8_t i=0;i<MAP2D_X;i++) g_cfg.map2d.cut_ms[5][i] = (uint16_t)(20 + 15 * i);
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  int32_t worst = 0;                                  // |sai khác| lớn nhất, 1/1000 ms
+  for (uint32_t x = 2000; x <= 15000; x += 37)
+    for (uint32_t y = 0; y <= 1100; y += 13){
+      const double r = ref2D(m, x, y);
+      const uint16_t got = CMAP::lookup2D(g_m, (uint16_t)x, (uint16_t)y);
+      worst = max(worst, (int32_t)(fabs(got - r) * 1000));
+    }
+  TEST_ASSERT_LESS_OR_EQUAL(1000, worst);
+}
+
+// Một hàng (ny = 1): trục Y bị bỏ qua
+void test_single_row(){
+  g_cfg.map2d.ny = 1;
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  for (uint16_t y : {0, 1, 3, 999})
+    TEST_ASSERT_EQUAL_UINT16(m.cut_ms[0][1], CMAP::lookup2D(g_m, m.x_rpm[1], y));
+}
+
+// Ô ngoài dải (import/NVS cũ, vd. 65535): bị kẹp khi biên dịch, nội suy không tràn int32
+void test_out_of_range_cell_clamped(){
+  g_cfg.map2d.cut_ms[0][1] = 65535;
+  g_cfg.map2d.cut_ms[1][1] = 0;
+  build();
+  const CutMap2D &m = g_cfg.map2d;
+  TEST_ASSERT_EQUAL_UINT16(CUT_MS_MAX, CMAP::lookup2D(g_m, m.x_rpm[1], m.y_val[0]));
+  TEST_ASSERT_EQUAL_UINT16(CUT_MS_MIN, CMAP::lookup2D(g_m, m.x_rpm[1], m.y_val[1]));
+  const uint16_t xm = (m.x_rpm[0] + m.x_rpm[1]) / 2;
+  TEST_ASSERT_UINT_WITHIN(1, (m.cut_ms[0][0] + CUT_MS_MAX) / 2, CMAP::lookup2D(g_m, xm, m.y_val[0]));
+  const uint16_t ym = (m.y_val[0] + m.y_val[1]) / 2;
+  for (uint16_t x = m.x_rpm[0]; x <= m.x_rpm[2]; x += 50){
+    const uint16_t v = CMAP::lookup2D(g_m, x, ym);
+    TEST_ASSERT_TRUE(v >= CUT_MS_MIN && v <= CUT_MS_MAX);
+  }
+}
+
+// Đo thời gian: lookup2D chạy mỗi lần cắt trong task 1 kHz -> phải rẻ (vài chục ns trên host)
+void test_benchmark(){
+  build();
+  static constexpr uint32_t N = 2000000;
+  volatile uint32_t sink = 0;
+  uint32_t x = 2500, y = 0, acc = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < N; k++) {
+    acc += CMAP::lookup2D(g_m, (uint16_t)x, (uint16_t)y);
+    x += 97;  if (x > 14500) x -= 12000;
+    y += 1;   if (y > 6) y = 0;
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  sink = acc;
+  for (uint32_t k = 0; k < N; k++) {
+    acc += CMAP::lookup(g_m, (uint16_t)x);
+    x += 97;  if (x > 14500) x -= 12000;
+  }
+  const auto t2 = std::chrono::steady_clock::now();
+  sink = acc; (void)sink;
+  const double ns2 = std::chrono::duration<double, std::nano>(t1 - t0).count() / N;
+  const double ns1 = std::chrono::duration<double, std::nano>(t2 - t1).count() / N;
+  char msg[96];
+  snprintf(msg, sizeof(msg), "lookup2D %.1f ns/lần, lookup 1D %.1f ns/lần (host)", ns2, ns1);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE_MESSAGE(ns2 < 1000.0, msg);    // chỉ chặn hồi quy thô (vd. lỡ thêm phép chia)
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_at_nodes);
+  RUN_TEST(test_clamp_outside);
+  RUN_TEST(test_edges_inside);
+  RUN_TEST(test_midpoints);
+  RUN_TEST(test_matches_reference);
+  RUN_TEST(test_single_row);
+  RUN_TEST(test_out_of_range_cell_clamped);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
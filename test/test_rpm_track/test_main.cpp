@@ -0,0 +1,156 @@
+// RPMTRK (alpha-beta) trên host: cạnh RPM tổng hợp từ quỹ đạo rpm(t) đã biết,
+// kiểm tra độ trễ khi tăng/giảm tốc đều và mức lọc nhiễu khi chu kỳ bị rung.
+// Chạy: pio test -e native -f test_rpm_track
+#include <unity.h>
+#include <vector>
+#include "rpm_track.cpp"
+
+// ---------- Giả lập RPM:: (dòng cạnh) + đồng hồ ----------
+static constexpr uint32_t PPR = 2;                       // 2 cạnh / vòng
+static constexpr uint32_t K   = 60000000UL / PPR;        // rpm = K / chu kỳ (µs), scale 1
+static std::vector<uint32_t> g_edges;
+static uint32_t g_now = 0;
+
+uint32_t micros(){ return g_now; }
+uint32_t millis(){ return g_now / 1000; }
+
+uint32_t RPM::edgeHead(){ return (uint32_t)g_edges.size(); }
+size_t RPM::readEdges(uint32_t &cursor, uint32_t *ts, size_t max){
+  size_t n = 0;
+  while (cursor < g_edges.size() && n < max) ts[n++] = g_edges[cursor++];
+  return n;
+}
+uint16_t RPM::periodToRpm(uint32_t p){
+  if (!p) return 0;
+  const uint32_t r = (K + p/2) / p;
+  return (uint16_t)(r > 20000 ? 20000 : r);
+}
+
+// Nhiễu xác định (LCG): trễ ghi timestamp 0..jit_ppm của chu kỳ (như trễ ngắt), không bao giờ sớm
+static uint32_t g_seed = 1;
+static uint32_t jitter(uint32_t period, uint32_t jit_ppm){
+  if (!jit_ppm) return 0;
+  g_seed = g_seed * 1664525u + 1013904223u;
+  const uint32_t u = (g_seed >> 8) % 1001;                              // 0..1000
+  return (uint32_t)((uint64_t)period * jit_ppm / 1000000 * u / 1000);
+}
+
+struct Sample { uint32_t t; int32_t truth, rpm, drpm; };
+
+// rpm(t) = r0 + a*t (rpm/s), chạy dur_ms; task 1 kHz gọi update() mỗi ms.
+// Trả mẫu mỗi ms sau warm_ms: rpm thật tại g_now, rpm lọc, dRPM/dt lọc.
+static std::vector<Sample> run(int32_t r0, int32_t a, uint32_t dur_ms, uint32_t warm_ms, uint32_t jit_ppm = 0){
+  g_edges.clear(); g_now = 0; g_seed = 1;
+  RPMTRK::begin();
+  std::vector<Sample> out;
+  double t = 1000;                                   // cạnh đầu tại 1 ms
+  g_edges.push_back((uint32_t)t);
+  uint32_t stamp = 0; bool pending = false;
+  for (uint32_t ms = 1; ms <= dur_ms; ms++) {
+    g_now = ms * 1000;
+    // sinh cạnh tới g_now: chu kỳ theo rpm ở giữa chu kỳ; cạnh chỉ "thấy" được khi timestamp (đã trễ) <= g_now
+    for (;;) {
+      if (!pending) {
+        double p = 60e6 / (PPR * (r0 + a * (t / 1e6)));
+        p = 60e6 / (PPR * (r0 + a * ((t + p / 2) / 1e6)));
+        t += p;
+        stamp = (uint32_t)t + jitter((uint32_t)p, jit_ppm);
+        pending = true;
+      }
+      if (stamp > g_now) break;
+      g_edges.push_back(stamp);
+      pending = false;
+    }
+    RPMTRK::update();
+    if (ms >= warm_ms) {
+      const int32_t truth = (int32_t)(r0 + a * (g_now / 1e6));
+      out.push_back(Sample{g_now, truth, (int32_t)RPMTRK::rpm(), RPMTRK::drpm()});
+    }
+  }
+  return out;
+}
+
+static int32_t maxAbsErr(const std::vector<Sample> &s){
+  int32_t m = 0;
+  for (const auto &x : s) m = max(m, abs(x.rpm - x.truth));
+  return m;
+}
+
+void setUp(){ RPMTRK::setGains(77, 13); }
+void tearDown(){}
+
+// Tốc độ đều: bám đúng, dRPM/dt ~ 0
+void test_steady(){
+  const auto s = run(6000, 0, 500, 200);
+  TEST_ASSERT_LESS_OR_EQUAL(6000 / 200, maxAbsErr(s));              // <= 0.5%
+  for (const auto &x : s) TEST_ASSERT_INT_WITHIN(200, 0, x.drpm);
+}
+
+// Tăng tốc đều số 1 (+8000 rpm/s): alpha-beta không có sai số xác lập với dốc -> trễ nhỏ
+void test_accel_ramp_lag(){
+  const auto s = run(4000, 8000, 700, 250);
+  // trễ tương đương < 10 ms của dốc (80 rpm)
+  TEST_ASSERT_LESS_OR_EQUAL(8000 * 10 / 1000, maxAbsErr(s));
+  for (const auto &x : s) TEST_ASSERT_INT_WITHIN(8000 / 5, 8000, x.drpm);   // ±20%
+}
+
+// Giảm tốc (nhả ga / sang số, -15000 rpm/s)
+void test_decel_ramp_lag(){
+  const auto s = run(12000, -15000, 400, 150);
+  TEST_ASSERT_LESS_OR_EQUAL(15000 * 10 / 1000, maxAbsErr(s));
+  for (const auto &x : s) TEST_ASSERT_INT_WITHIN(15000 / 5, -15000, x.drpm);
+}
+
+// Trễ ghi cạnh 0..4% chu kỳ: rpm lọc dao động ít hơn hẳn rpm thô của từng chu kỳ
+void test_noise_attenuation(){
+  const auto s = run(8000, 0, 1000, 300, 40000);
+  int64_t se = 0, seRaw = 0;
+  for (const auto &x : s) se += (int64_t)(x.rpm - x.truth) * (x.rpm - x.truth);
+  for (size_t i = 1; i < g_edges.size(); i++) {
+    const int32_t e = (int32_t)RPM::periodToRpm(g_edges[i] - g_edges[i-1]) - 8000;
+    seRaw += (int64_t)e * e;
+  }
+  const int32_t rms    = (int32_t)sqrt((double)se / s.size());
+  const int32_t rmsRaw = (int32_t)sqrt((double)seRaw / (g_edges.size() - 1));
+  TEST_ASSERT_LESS_THAN(rmsRaw / 3, rms);                              // giảm nhiễu >= 3 lần
+  TEST_ASSERT_LESS_OR_EQUAL(8000 / 100, maxAbsErr(s));                 // <= 1% (thô tới ±4%)
+  TEST_ASSERT_EQUAL(0, RPMTRK::rejected());                           // rung không bị coi là mất xung
+}
+
+// Tăng tốc có rung: vẫn theo dốc, không trôi
+void test_accel_ramp_noisy(){
+  const auto s = run(4000, 8000, 700, 250, 10000);
+  int64_t sum = 0;
+  for (const auto &x : s) sum += x.rpm - x.truth;
+  TEST_ASSERT_INT_WITHIN(50, 0, (int32_t)(sum / (int64_t)s.size()));   // lệch trung bình
+  TEST_ASSERT_LESS_OR_EQUAL(8000 * 10 / 1000 + 40, maxAbsErr(s));
+}
+
+// Mất một cạnh: bị loại, không kéo rpm xuống một nửa
+void test_missing_edge_rejected(){
+  g_edges.clear(); g_now = 0;
+  RPMTRK::begin();
+  const uint32_t p = K / 6000;                 // 5000 µs
+  const uint32_t rej0 = RPMTRK::rejected();
+  uint32_t t = 1000, minRpm = 0xFFFF;
+  for (uint32_t k = 0; k < 200; k++) {
+    t += p;
+    if (k != 100) g_edges.push_back(t);        // cạnh 100 mất -> một chu kỳ gấp đôi
+    g_now = t;
+    RPMTRK::update();
+    if (k > 50) minRpm = min<uint32_t>(minRpm, RPMTRK::rpm());
+  }
+  TEST_ASSERT_EQUAL(rej0 + 1, RPMTRK::rejected());
+  TEST_ASSERT_GREATER_OR_EQUAL(6000 - 60, minRpm);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_steady);
+  RUN_TEST(test_accel_ramp_lag);
+  RUN_TEST(test_decel_ramp_lag);
+  RUN_TEST(test_noise_attenuation);
+  RUN_TEST(test_accel_ramp_noisy);
+  RUN_TEST(test_missing_edge_rejected);
+  return UNITY_END();
+}
@@ -0,0 +1,77 @@
+# Nén sẵn các file UI trong data/ thành <file>.gz trước khi dựng ảnh LittleFS.
+# Web server ưu tiên bản .gz (gửi kèm header nén gzip) và gắn ETag theo CRC32 nội dung.
+# Đồng thời sinh src/ui_embed.h: index.html nén nhúng thẳng vào firmware (flash),
+# để portal vẫn có UI khi LittleFS trống/bị format.
+#
+# PlatformIO: extra_scripts = pre:tools/gzip_assets.py  (chạy mỗi lần build + trước buildfs/uploadfs)
+# Chạy tay:   python tools/gzip_assets.py [data_dir]
+import gzip
+import os
+import sys
+import zlib
+
+EXTS = (".html", ".htm", ".js", ".css", ".svg", ".json", ".ico")
+
+
+def gzip_dir(data_dir):
+    n = 0
+    for root, _, files in os.walk(data_dir):
+        for name in files:
+            if not name.lower().endswith(EXTS):
+                continue
+            src = os.path.join(root, name)
+            dst = src + ".gz"
+            if os.path.exists(dst) and os.path.getmtime(dst) >= os.path.getmtime(src):
+                continue
+            with open(src, "rb") as f:
+                raw = f.read()
+            # mtime=0: cùng nội dung -> cùng byte -> cùng ETag giữa các lần build
+            with open(dst, "wb") as f:
+                f.write(gzip.compress(raw, compresslevel=9, mtime=0))
+            print("[gzip] %s: %d -> %d bytes" % (os.path.relpath(src, data_dir), len(raw), os.path.getsize(dst)))
+            n += 1
+    return n
+
+
+def embed_index(data_dir, out_path):
+    src = os.path.join(data_dir, "index.html")
+    if not os.path.exists(src):
+        return False
+    with open(src, "rb") as f:
+        gz = gzip.compress(f.read(), compresslevel=9, mtime=0)
+    crc = zlib.crc32(gz) & 0xFFFFFFFF        # = esp_rom_crc32_le(0, ...) -> cùng ETag với bản trên LittleFS
+    rows = [", ".join("0x%02x" % b for b in gz[i:i + 16]) for i in range(0, len(gz), 16)]
+    text = (
+        "// Sinh bởi tools/gzip_assets.py từ data/index.html - không sửa tay, không commit.\n"
+        "#pragma once\n"
+        "#include <stdint.h>\n"
+        "#include <stddef.h>\n\n"
+        "static constexpr char     UI_EMBED_ETAG[] = \"\\\"%08x\\\"\";\n"
+        "static constexpr size_t   UI_EMBED_GZ_LEN = %d;\n"
+        "alignas(4) static constexpr uint8_t UI_EMBED_GZ[UI_EMBED_GZ_LEN] = {\n  %s\n};\n"
+    ) % (crc, len(gz), ",\n  ".join(rows))
+    # chỉ ghi khi đổi nội dung, tránh build lại web_ui.cpp mỗi lần
+    if os.path.exists(out_path):
+        with open(out_path, "r", encoding="utf-8") as f:
+            if f.read() == text:
+                return False
+    with open(out_path, "w", encoding="utf-8") as f:
+        f.write(text)
+    print("[embed] index.html -> %s: %d bytes, etag %08x" % (os.path.relpath(out_path), len(gz), crc))
+    return True
+
+
+try:
+    Import("env")  # noqa: F821  (PlatformIO SCons)
+
+    def _before_fs(source, target, env):
+        gzip_dir(env.subst("$PROJECT_DATA_DIR"))
+
+    embed_index(env.subst("$PROJECT_DATA_DIR"), os.path.join(env.subst("$PROJECT_SRC_DIR"), "ui_embed.h"))  # noqa: F821
+    env.AddPreAction("$BUILD_DIR/${ESP32_FS_IMAGE_NAME}.bin", _before_fs)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        here = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+        data = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, "data")
+        gzip_dir(data)
+        embed_index(data, os.path.join(here, "src", "ui_embed.h"))